@@ -0,0 +1,180 @@
+/*
+ * Copyright (C) 2018 GlobalLogic
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "HealthHAL"
+
+#include <EnergyIntegrator.h>
+
+#include <inttypes.h>
+#include <math.h>
+#include <time.h>
+
+#include <algorithm>
+
+#include <android-base/file.h>
+#include <android-base/logging.h>
+#include <android-base/parseint.h>
+#include <android-base/stringprintf.h>
+#include <utils/SystemClock.h>
+
+using android::base::StringPrintf;
+using android::base::WriteStringToFd;
+
+namespace android {
+namespace hardware {
+namespace health {
+namespace V2_0 {
+namespace renesas {
+
+// uA * uV = pW; pW * ns -> nWh.
+static constexpr double kPwNsPerNwh = 3.6e15;
+// uAh * uV = pWh -> nWh.
+static constexpr double kPwhPerNwh = 1e3;
+
+static int64_t thread_cpu_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+constexpr int EnergyIntegrator::kMaxGapIntervals;
+constexpr int64_t EnergyIntegrator::kAnchorPeriodMs;
+
+bool EnergyIntegrator::init(const struct healthd_config& config, int intervalMs) {
+    std::lock_guard<std::mutex> _lock(lock_);
+    max_gap_ns_ = static_cast<int64_t>(kMaxGapIntervals) * intervalMs * 1000000;
+    if (config.batteryCurrentNowPath.isEmpty() || config.batteryVoltagePath.isEmpty()) {
+        return false;
+    }
+    reader_.clear();
+    current_ = reader_.add(config.batteryCurrentNowPath.string());
+    voltage_ = reader_.add(config.batteryVoltagePath.string());
+    if (current_ < 0 || voltage_ < 0) {
+        return false;
+    }
+    if (!config.batteryChargeCounterPath.isEmpty()) {
+        charge_counter_ = reader_.add(config.batteryChargeCounterPath.string());
+    }
+    return true;
+}
+
+bool EnergyIntegrator::readPower(double* powerPw, double* voltageUv) {
+    int64_t current;
+    int64_t voltage;
+    if (!android::base::ParseInt(reader_.value(current_), &current) ||
+        !android::base::ParseInt(reader_.value(voltage_), &voltage)) {
+        return false;
+    }
+    *powerPw = static_cast<double>(current) * voltage;
+    *voltageUv = voltage;
+    return true;
+}
+
+bool EnergyIntegrator::anchor(double voltageUv, int64_t nowNs, bool measureDrift) {
+    int64_t chargeUah;
+    if (charge_counter_ < 0 ||
+        !android::base::ParseInt(reader_.value(charge_counter_), &chargeUah)) {
+        return false;
+    }
+    double anchoredNwh = chargeUah * voltageUv / kPwhPerNwh;
+    if (measureDrift) {
+        last_drift_nwh_ = fabs(energy_nwh_ - anchoredNwh);
+        max_drift_nwh_ = std::max(max_drift_nwh_, last_drift_nwh_);
+        corrections_++;
+    }
+    energy_nwh_ = anchoredNwh;
+    last_anchor_ns_ = nowNs;
+    return true;
+}
+
+void EnergyIntegrator::sample() {
+    std::lock_guard<std::mutex> _lock(lock_);
+    int64_t cpuStart = thread_cpu_ns();
+
+    // Boot time, so that a suspend shows up as a gap.
+    int64_t now = elapsedRealtimeNano();
+    reader_.refresh();
+
+    double power;
+    double voltage;
+    if (!readPower(&power, &voltage)) {
+        failed_samples_++;
+    } else if (!started_) {
+        anchor(voltage, now, false);
+        started_ = true;
+        last_time_ns_ = now;
+        last_power_pw_ = power;
+    } else {
+        int64_t dtNs = now - last_time_ns_;
+        if (dtNs > max_gap_ns_) {
+            // The jump includes energy used in suspend, not integration error.
+            if (anchor(voltage, now, false)) {
+                reanchors_++;
+            } else {
+                skipped_ns_ += dtNs;
+            }
+        } else {
+            energy_nwh_ += (last_power_pw_ + power) / 2 * dtNs / kPwNsPerNwh;
+            if (now - last_anchor_ns_ >= kAnchorPeriodMs * 1000000) {
+                anchor(voltage, now, true);
+            }
+        }
+        last_time_ns_ = now;
+        last_power_pw_ = power;
+    }
+
+    uint64_t cpuNs = thread_cpu_ns() - cpuStart;
+    samples_++;
+    cpu_ns_ += cpuNs;
+    max_cpu_ns_ = std::max(max_cpu_ns_, cpuNs);
+}
+
+bool EnergyIntegrator::read(int64_t* energyNwh) {
+    std::lock_guard<std::mutex> _lock(lock_);
+    if (!started_) {
+        return false;
+    }
+    *energyNwh = llround(energy_nwh_);
+    return true;
+}
+
+void EnergyIntegrator::dump(int fd, int intervalMs) {
+    std::lock_guard<std::mutex> _lock(lock_);
+    double meanCpuUs = samples_ ? cpu_ns_ / 1000.0 / samples_ : 0;
+    std::string error =
+            charge_counter_ < 0
+                    ? std::string("unbounded (no charge_counter to correct against)")
+                    : StringPrintf("drift vs charge_counter*voltage_now per %" PRId64
+                                   "s: last=%.0fnWh max=%.0fnWh over %" PRIu64 " corrections",
+                                   kAnchorPeriodMs / 1000, last_drift_nwh_, max_drift_nwh_,
+                                   corrections_);
+    WriteStringToFd(StringPrintf("\nsoftware energy counter (every %dms): energy=%.0fnWh "
+                                 "reanchors=%" PRIu64 " skipped=%.0fs samples=%" PRIu64
+                                 " failed=%" PRIu64
+                                 " cpu_per_sample mean=%.1fus max=%.1fus (%.4f%% cpu)\n"
+                                 "  error: %s\n",
+                                 intervalMs, energy_nwh_, reanchors_, skipped_ns_ / 1e9,
+                                 samples_, failed_samples_, meanCpuUs, max_cpu_ns_ / 1000.0,
+                                 intervalMs > 0 ? meanCpuUs / 10.0 / intervalMs : 0.0,
+                                 error.c_str()),
+                    fd);
+}
+
+}  // namespace renesas
+}  // namespace V2_0
+}  // namespace health
+}  // namespace hardware
+}  // namespace android
@@ -0,0 +1,102 @@
+/*
+ * Copyright (C) 2018 GlobalLogic
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_HARDWARE_HEALTH_V2_0_RENESAS_ENERGY_INTEGRATOR_H
+#define ANDROID_HARDWARE_HEALTH_V2_0_RENESAS_ENERGY_INTEGRATOR_H
+
+#include <stdint.h>
+
+#include <mutex>
+
+#include <healthd/healthd.h>
+
+#include <SysfsReader.h>
+
+namespace android {
+namespace hardware {
+namespace health {
+namespace V2_0 {
+namespace renesas {
+
+// Software energy counter for batteries whose fuel gauge has none. Integrates
+// current_now * voltage_now with the trapezoidal rule, starting from
+// charge_counter * voltage_now when the gauge reports a charge counter.
+// current_now is taken as positive while charging, like
+// BatteryProperties::batteryCurrent.
+//
+// With a charge counter, the integral is re-anchored to
+// charge_counter * voltage_now every kAnchorPeriodMs, so its drift stays
+// bounded by what accumulates in one period; the difference seen at each
+// re-anchor is reported as the error. Without one, nothing corrects the
+// integral and its error is unbounded.
+//
+// The sampling timer does not run in suspend, and one awake reading says
+// nothing about the power drawn while suspended. A gap of more than
+// kMaxGapIntervals intervals is therefore not integrated: the energy is
+// re-anchored, or, without a charge counter, the gap is skipped and
+// reported in dump().
+class EnergyIntegrator {
+   public:
+    static constexpr int kMaxGapIntervals = 3;
+    static constexpr int64_t kAnchorPeriodMs = 60 * 1000;
+
+    // Uses the paths BatteryMonitor::init() found in |config|, sampled every
+    // |intervalMs|. Returns false if the battery reports no current or voltage.
+    bool init(const struct healthd_config& config, int intervalMs);
+
+    void sample();
+    // Energy in nWh, for healthd_config::energyCounter.
+    bool read(int64_t* energyNwh);
+
+    void dump(int fd, int intervalMs);
+
+   private:
+    bool readPower(double* powerPw, double* voltageUv);
+    // Sets the energy to charge_counter * |voltageUv| at |nowNs|; false without
+    // a counter. With |measureDrift|, the jump is recorded as integration error.
+    bool anchor(double voltageUv, int64_t nowNs, bool measureDrift);
+
+    std::mutex lock_;
+    SysfsReader reader_{SysfsReader::Backend::SYNC};
+    int current_ = -1;
+    int voltage_ = -1;
+    int charge_counter_ = -1;
+    int64_t max_gap_ns_ = 0;
+
+    bool started_ = false;
+    int64_t last_time_ns_ = 0;
+    double last_power_pw_ = 0;
+    double energy_nwh_ = 0;
+    int64_t last_anchor_ns_ = 0;
+
+    uint64_t corrections_ = 0;
+    double last_drift_nwh_ = 0;
+    double max_drift_nwh_ = 0;
+    uint64_t reanchors_ = 0;
+    int64_t skipped_ns_ = 0;
+    uint64_t samples_ = 0;
+    uint64_t failed_samples_ = 0;
+    uint64_t cpu_ns_ = 0;
+    uint64_t max_cpu_ns_ = 0;
+};
+
+}  // namespace renesas
+}  // namespace V2_0
+}  // namespace health
+}  // namespace hardware
+}  // namespace android
+
+#endif  // ANDROID_HARDWARE_HEALTH_V2_0_RENESAS_ENERGY_INTEGRATOR_H
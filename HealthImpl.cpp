@@ -17,12 +17,15 @@
 #include <android-base/logging.h>
 
 #include <android-base/file.h>
+#include <android-base/properties.h>
 #include <HealthImpl.h>
+#include <HealthStress.h>
 
 #include <hal_conversion.h>
 #include <hidl/HidlTransportSupport.h>
 
 extern void healthd_battery_update_internal(bool);
+extern void healthd_dump_stalls(int fd);
 
 namespace android {
 namespace hardware {
@@ -32,26 +35,14 @@ namespace renesas {
 
 sp<Health> Health::instance_;
 
-static const V2_0::HealthInfo fakeHealthInfo {
-    .legacy = {
-        .chargerAcOnline       = true,
-        .maxChargingCurrent    = 5000000,
-        .maxChargingVoltage    = 12000000,
-        .batteryPresent        = false,
-        .batteryChargeCounter  = 1,
-        .batteryCurrent        = 0,
-        .batteryLevel          = 0,
-        .batteryStatus         = V1_0::BatteryStatus::UNKNOWN,
-        .batteryHealth         = V1_0::BatteryHealth::UNKNOWN,
-        .batteryTechnology     = "AC Power",
-    },
-    .diskStats = std::vector<DiskStats>(),
-    .storageInfos = std::vector<StorageInfo>(),
-};
+// Client update() calls this soon after the start of another update share its result.
+static constexpr std::chrono::milliseconds kUpdateCoalesceWindow(200);
 
 Health::Health(struct healthd_config* c) {
     battery_monitor_ = std::make_unique<BatteryMonitor>();
     battery_monitor_->init(c);
+    properties_.init(c);
+    snapshot_.init();
 }
 
 // Methods from IHealth follow.
@@ -60,9 +51,19 @@ Return<Result> Health::registerCallback(const sp<IHealthInfoCallback>& callback)
         return Result::SUCCESS;
     }
 
+    std::shared_ptr<const HealthInfo> info;
     {
-        std::lock_guard<std::mutex> _lock(callbacks_lock_);
+        TimedLockGuard _lock(callbacks_lock_, callbacks_lock_stats_);
         callbacks_.push_back(callback);
+        // The current HealthInfo is enough for a new client; sending it under
+        // callbacks_lock_ keeps it from overtaking a newer notifyListeners().
+        {
+            std::lock_guard<std::mutex> _infoLock(health_info_lock_);
+            info = health_info_;
+        }
+        if (info != nullptr) {
+            (void)callback->healthInfoChanged(*info).isOk();  // ignore errors
+        }
         // unlock
     }
 
@@ -73,7 +74,7 @@ Return<Result> Health::registerCallback(const sp<IHealthInfoCallback>& callback)
         // ignore the error
     }
 
-    return update();
+    return info != nullptr ? Result::SUCCESS : update();
 }
 
 bool Health::unregisterCallbackInternal(const sp<IBase>& callback) {
@@ -82,7 +83,7 @@ bool Health::unregisterCallbackInternal(const sp<IBase>& callback) {
     }
 
     bool removed = false;
-    std::lock_guard<std::mutex> _lock(callbacks_lock_);
+    TimedLockGuard _lock(callbacks_lock_, callbacks_lock_stats_);
     for (auto it = callbacks_.begin(); it != callbacks_.end();) {
         if (interfacesEqual(*it, callback)) {
             it = callbacks_.erase(it);
@@ -99,66 +100,109 @@ Return<Result> Health::unregisterCallback(const sp<IHealthInfoCallback>& callbac
     return unregisterCallbackInternal(callback) ? Result::SUCCESS : Result::NOT_FOUND;
 }
 
-template <typename T>
-void getProperty(const std::unique_ptr<BatteryMonitor>& monitor __unused,
-                 int id __unused, T defaultValue,
-                 const std::function<void(Result, T)>& callback) {
-    T ret = defaultValue;
-    Result result = Result::SUCCESS;
-    callback(result, static_cast<T>(ret));
+template <size_t I>
+void Health::getProperty(const std::function<void(Result, BatteryPropertyType<I>)>& callback) {
+    BatteryPropertyType<I> value;
+    Result result = properties_.read<I>(snapshot_, &value);
+    callback(result, value);
 }
 
 Return<void> Health::getChargeCounter(getChargeCounter_cb _hidl_cb) {
-    getProperty<int32_t>(battery_monitor_, BATTERY_PROP_CHARGE_COUNTER, 1, _hidl_cb);
+    getProperty<kChargeCounter>(_hidl_cb);
     return Void();
 }
 
 Return<void> Health::getCurrentNow(getCurrentNow_cb _hidl_cb) {
-    getProperty<int32_t>(battery_monitor_, BATTERY_PROP_CURRENT_NOW, 1, _hidl_cb);
+    getProperty<kCurrentNow>(_hidl_cb);
     return Void();
 }
 
 Return<void> Health::getCurrentAverage(getCurrentAverage_cb _hidl_cb) {
-    getProperty<int32_t>(battery_monitor_, BATTERY_PROP_CURRENT_AVG, 1, _hidl_cb);
+    getProperty<kCurrentAverage>(_hidl_cb);
     return Void();
 }
 
 Return<void> Health::getCapacity(getCapacity_cb _hidl_cb) {
-    getProperty<int32_t>(battery_monitor_, BATTERY_PROP_CAPACITY, 1, _hidl_cb);
+    getProperty<kCapacity>(_hidl_cb);
     return Void();
 }
 
 Return<void> Health::getEnergyCounter(getEnergyCounter_cb _hidl_cb) {
-    getProperty<int64_t>(battery_monitor_, BATTERY_PROP_ENERGY_COUNTER, 1, _hidl_cb);
+    getProperty<kEnergyCounter>(_hidl_cb);
     return Void();
 }
 
 Return<void> Health::getChargeStatus(getChargeStatus_cb _hidl_cb) {
-    getProperty(battery_monitor_, BATTERY_PROP_BATTERY_STATUS, BatteryStatus::FULL, _hidl_cb);
+    getProperty<kChargeStatus>(_hidl_cb);
     return Void();
 }
 
 Return<Result> Health::update() {
+    return requestUpdate(kUpdateCoalesceWindow);
+}
+
+Result Health::requestUpdate(std::chrono::milliseconds maxAge) {
     if (!healthd_mode_ops || !healthd_mode_ops->battery_update) {
         LOG(WARNING) << "health@2.0: update: not initialized. "
                      << "update() should not be called in charger / recovery.";
         return Result::UNKNOWN;
     }
 
-    // Retrieve all information and call healthd_mode_ops->battery_update, which calls
-    // notifyListeners.
-    bool chargerOnline = battery_monitor_->update();
+    std::unique_lock<std::mutex> lock(update_lock_);
+    update_requests_++;
 
-    // adjust uevent / wakealarm periods
-    healthd_battery_update_internal(chargerOnline);
+    // Wait for an update that started no earlier than |maxAge| ago. Requests
+    // arriving while one runs all wait for the same next update.
+    uint64_t target = started_updates_ + 1;
+    if (started_updates_ > 0 &&
+        std::chrono::steady_clock::now() - last_update_start_ <= maxAge) {
+        target = started_updates_;
+    }
+
+    while (completed_updates_ < target) {
+        if (update_running_) {
+            update_cv_.wait(lock);
+            continue;
+        }
+        update_running_ = true;
+        started_updates_++;
+        last_update_start_ = std::chrono::steady_clock::now();
+        lock.unlock();
+
+        // Retrieve all information and call healthd_mode_ops->battery_update, which calls
+        // notifyListeners.
+        bool chargerOnline = battery_monitor_->update();
+
+        // adjust uevent / wakealarm periods
+        healthd_battery_update_internal(chargerOnline);
+
+        lock.lock();
+        completed_updates_++;
+        update_running_ = false;
+        update_cv_.notify_all();
+    }
 
     return Result::SUCCESS;
 }
 
-void Health::notifyListeners(HealthInfo* healthInfo __unused) {
-    std::lock_guard<std::mutex> _lock(callbacks_lock_);
+void Health::notifyListeners(HealthInfo&& healthInfo) {
+    BatteryPropertyType<kCurrentAverage> currentAverage;
+    if (properties_.readSource<kCurrentAverage>(&currentAverage) == Result::SUCCESS) {
+        healthInfo.batteryCurrentAverage = currentAverage;
+    }
+    snapshot_.publish(healthInfo);
+
+    // From here on the update is immutable and shared by callbacks and getters.
+    std::shared_ptr<const HealthInfo> published =
+            std::make_shared<const HealthInfo>(std::move(healthInfo));
+    {
+        std::lock_guard<std::mutex> _lock(health_info_lock_);
+        health_info_ = published;
+    }
+
+    TimedLockGuard _lock(callbacks_lock_, callbacks_lock_stats_);
     for (auto it = callbacks_.begin(); it != callbacks_.end();) {
-        auto ret = (*it)->healthInfoChanged(fakeHealthInfo);
+        auto ret = (*it)->healthInfoChanged(*published);
         if (!ret.isOk() && ret.isDeadObject()) {
             it = callbacks_.erase(it);
         } else {
@@ -167,9 +211,82 @@ void Health::notifyListeners(HealthInfo* healthInfo __unused) {
     }
 }
 
-Return<void> Health::debug(const hidl_handle& handle, const hidl_vec<hidl_string>&) {
+std::vector<sp<IHealthInfoCallback>> Health::detachCallbacks() {
+    TimedLockGuard _lock(callbacks_lock_, callbacks_lock_stats_);
+    std::vector<sp<IHealthInfoCallback>> detached;
+    detached.swap(callbacks_);
+    return detached;
+}
+
+void Health::reattachCallbacks(std::vector<sp<IHealthInfoCallback>>&& callbacks) {
+    std::shared_ptr<const HealthInfo> info;
+    {
+        std::lock_guard<std::mutex> _lock(health_info_lock_);
+        info = health_info_;
+    }
+
+    TimedLockGuard _lock(callbacks_lock_, callbacks_lock_stats_);
+    for (auto& callback : callbacks) {
+        if (info != nullptr) {
+            auto ret = callback->healthInfoChanged(*info);
+            if (!ret.isOk() && ret.isDeadObject()) {
+                continue;
+            }
+        }
+        callbacks_.push_back(callback);
+    }
+}
+
+std::shared_ptr<const HealthInfo> Health::getPublishedHealthInfo() {
+    {
+        std::lock_guard<std::mutex> _lock(health_info_lock_);
+        if (health_info_ != nullptr) {
+            return health_info_;
+        }
+    }
+    // Nothing published yet; the main loop runs an update before serving
+    // binder, so this only happens if that update failed.
+    update();
+    std::lock_guard<std::mutex> _lock(health_info_lock_);
+    return health_info_;
+}
+
+Return<void> Health::debug(const hidl_handle& handle, const hidl_vec<hidl_string>& args) {
     if (handle != nullptr && handle->numFds >= 1) {
         int fd = handle->data[0];
+
+        // lshal debug android.hardware.health@2.0::IHealth/default --sysfs-backend io_uring
+        if (args.size() >= 2 && args[0] == "--sysfs-backend") {
+            bool ok = set_storage_sysfs_backend(args[1]);
+            android::base::WriteStringToFd(std::string("sysfs backend ") + args[1].c_str() +
+                                                   (ok ? ": ok\n" : ": unsupported\n"),
+                                           fd);
+            fsync(fd);
+            return Void();
+        }
+
+        // The handle must be a unix socket; the snapshot fd is sent back over it.
+        if (args.size() == 1 && args[0] == "--snapshot-fd") {
+            if (!snapshot_.sendFd(fd)) {
+                LOG(WARNING) << "health@2.0: debug: cannot hand out snapshot fd";
+            }
+            return Void();
+        }
+
+        if (args.size() >= 1 && args[0] == "--stress") {
+            StressConfig config;
+            std::string error;
+            if (!android::base::GetBoolProperty("ro.debuggable", false)) {
+                android::base::WriteStringToFd("--stress needs a debuggable build\n", fd);
+            } else if (!parseStressArgs(args, &config, &error)) {
+                android::base::WriteStringToFd("invalid --stress arguments: " + error + "\n", fd);
+            } else {
+                runStress(this, config, fd);
+            }
+            fsync(fd);
+            return Void();
+        }
+
         battery_monitor_->dumpState(fd);
 
         getHealthInfo([fd](auto res, const auto& info) {
@@ -181,6 +298,18 @@ Return<void> Health::debug(const hidl_handle& handle, const hidl_vec<hidl_string
             }
             android::base::WriteStringToFd("\n", fd);
         });
+        {
+            std::lock_guard<std::mutex> _lock(update_lock_);
+            android::base::WriteStringToFd(
+                    "\nupdate requests: " + std::to_string(update_requests_) +
+                            ", updates run: " + std::to_string(completed_updates_) + "\n",
+                    fd);
+        }
+        properties_.dump(snapshot_, fd);
+        dump_storage_stats(fd);
+        dump_io_rates(fd);
+        dump_energy_integrator(fd);
+        healthd_dump_stalls(fd);
 
         fsync(fd);
     }
@@ -188,35 +317,32 @@ Return<void> Health::debug(const hidl_handle& handle, const hidl_vec<hidl_string
 }
 
 Return<void> Health::getStorageInfo(getStorageInfo_cb _hidl_cb) {
-    std::vector<struct StorageInfo> info;
-    get_storage_info(info);
-    hidl_vec<struct StorageInfo> info_vec(info);
-    if (!info.size()) {
-        _hidl_cb(Result::NOT_SUPPORTED, info_vec);
+    auto info = getPublishedHealthInfo();
+    if (info == nullptr || !info->storageInfos.size()) {
+        _hidl_cb(Result::NOT_SUPPORTED, {});
     } else {
-        _hidl_cb(Result::SUCCESS, info_vec);
+        _hidl_cb(Result::SUCCESS, info->storageInfos);
     }
     return Void();
 }
 
 Return<void> Health::getDiskStats(getDiskStats_cb _hidl_cb) {
-    std::vector<struct DiskStats> stats;
-    get_disk_stats(stats);
-    hidl_vec<struct DiskStats> stats_vec(stats);
-    if (!stats.size()) {
-        _hidl_cb(Result::NOT_SUPPORTED, stats_vec);
+    auto info = getPublishedHealthInfo();
+    if (info == nullptr || !info->diskStats.size()) {
+        _hidl_cb(Result::NOT_SUPPORTED, {});
     } else {
-        _hidl_cb(Result::SUCCESS, stats_vec);
+        _hidl_cb(Result::SUCCESS, info->diskStats);
     }
     return Void();
 }
 
 Return<void> Health::getHealthInfo(getHealthInfo_cb _hidl_cb) {
-    V2_0::HealthInfo healthInfo(fakeHealthInfo);
-    std::vector<StorageInfo> info;
-    get_storage_info(info);
-    healthInfo.storageInfos = info;
-    _hidl_cb(Result::SUCCESS, healthInfo);
+    auto info = getPublishedHealthInfo();
+    if (info == nullptr) {
+        _hidl_cb(Result::UNKNOWN, {});
+    } else {
+        _hidl_cb(Result::SUCCESS, *info);
+    }
     return Void();
 }
 
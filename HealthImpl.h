@@ -1,12 +1,19 @@
 #ifndef ANDROID_HARDWARE_HEALTH_V2_0_HEALTH_H
 #define ANDROID_HARDWARE_HEALTH_V2_0_HEALTH_H
 
+#include <chrono>
+#include <condition_variable>
 #include <memory>
+#include <mutex>
+#include <string>
 #include <vector>
 
 #include <android/hardware/health/1.0/types.h>
 #include <android/hardware/health/2.0/IHealth.h>
 #include <healthd/BatteryMonitor.h>
+#include <HealthProperties.h>
+#include <HealthSnapshotWriter.h>
+#include <LockHoldStats.h>
 #include <hidl/Status.h>
 
 using android::hardware::health::V2_0::StorageInfo;
@@ -14,6 +21,15 @@ using android::hardware::health::V2_0::DiskStats;
 
 void get_storage_info(std::vector<struct StorageInfo>& info);
 void get_disk_stats(std::vector<struct DiskStats>& stats);
+void dump_storage_stats(int fd);
+void dump_io_rates(int fd);
+void dump_energy_integrator(int fd);
+bool set_storage_sysfs_backend(const std::string& name);
+// Makes the next get_storage_info() rescan for MMCs.
+void invalidate_storage_devices();
+// healthd_register_event() that also names |handler| in main loop stall reports.
+int healthd_register_named_event(int fd, void (*handler)(uint32_t), EventWakeup wakeup,
+                                 const char* name);
 
 namespace android {
 namespace hardware {
@@ -37,7 +53,12 @@ struct Health : public IHealth, hidl_death_recipient {
     Health(struct healthd_config* c);
 
     // TODO(b/62229583): clean up and hide these functions after update() logic is simplified.
-    void notifyListeners(HealthInfo* info);
+    // Publishes |info| as the latest HealthInfo and sends it to every callback.
+    void notifyListeners(HealthInfo&& info);
+
+    // Runs BatteryMonitor::update() unless one that started at most |maxAge|
+    // ago is running or done; concurrent requests share a single run.
+    Result requestUpdate(std::chrono::milliseconds maxAge);
 
     // Methods from IHealth follow.
     Return<Result> registerCallback(const sp<IHealthInfoCallback>& callback) override;
@@ -58,14 +79,42 @@ struct Health : public IHealth, hidl_death_recipient {
 
     void serviceDied(uint64_t cookie, const wp<IBase>& /* who */) override;
 
+    // Hold times of callbacks_lock_; reset and read by the stress harness.
+    LockHoldStats& callbackLockStats() { return callbacks_lock_stats_; }
+    // Used by the stress harness to keep real clients out of a run: removes
+    // every registered callback, and later puts them back and sends them the
+    // latest HealthInfo.
+    std::vector<sp<IHealthInfoCallback>> detachCallbacks();
+    void reattachCallbacks(std::vector<sp<IHealthInfoCallback>>&& callbacks);
+
    private:
     static sp<Health> instance_;
 
     std::mutex callbacks_lock_;
+    LockHoldStats callbacks_lock_stats_;
     std::vector<sp<IHealthInfoCallback>> callbacks_;
     std::unique_ptr<BatteryMonitor> battery_monitor_;
+    BatteryPropertyReader properties_;
+    // Latest HealthInfo for clients that map it instead of calling getHealthInfo().
+    HealthSnapshotWriter snapshot_;
+
+    std::mutex update_lock_;
+    std::condition_variable update_cv_;
+    bool update_running_ = false;
+    uint64_t update_requests_ = 0;
+    uint64_t started_updates_ = 0;
+    uint64_t completed_updates_ = 0;
+    std::chrono::steady_clock::time_point last_update_start_;
+
+    // Latest HealthInfo built by notifyListeners(); never modified once published.
+    std::mutex health_info_lock_;
+    std::shared_ptr<const HealthInfo> health_info_;
 
     bool unregisterCallbackInternal(const sp<IBase>& cb);
+    std::shared_ptr<const HealthInfo> getPublishedHealthInfo();
+
+    template <size_t I>
+    void getProperty(const std::function<void(Result, BatteryPropertyType<I>)>& callback);
 };
 
 }  // namespace renesas
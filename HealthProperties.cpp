@@ -0,0 +1,117 @@
+/*
+ * Copyright (C) 2018 GlobalLogic
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "android.hardware.health@2.0-impl"
+
+#include <HealthProperties.h>
+
+#include <android-base/file.h>
+#include <android-base/logging.h>
+#include <android-base/stringprintf.h>
+
+using android::base::StringPrintf;
+using android::base::WriteStringToFd;
+
+namespace android {
+namespace hardware {
+namespace health {
+namespace V2_0 {
+namespace renesas {
+
+namespace {
+
+template <typename T>
+std::string formatValue(T value) {
+    return std::to_string(value);
+}
+
+std::string formatValue(BatteryStatus value) {
+    return toString(value);
+}
+
+// Opens the sysfs path of every property that has one.
+template <size_t... I>
+void openProperties(const struct healthd_config& config, SysfsReader& reader,
+                    std::array<int, kNumBatteryProperties>& handles, std::index_sequence<I...>) {
+    auto open = [&](size_t i, android::String8 healthd_config::*path) {
+        handles[i] = (path == nullptr || (config.*path).isEmpty())
+                             ? -1
+                             : reader.add((config.*path).string());
+    };
+    int expand[] = {(open(I, std::get<I>(kBatteryProperties).path), 0)...};
+    (void)expand;
+}
+
+}  // namespace
+
+void BatteryPropertyReader::init(struct healthd_config* config) {
+    std::lock_guard<std::mutex> _lock(lock_);
+    config_ = config;
+    reader_.clear();
+    openProperties(*config, reader_, handles_, std::make_index_sequence<kNumBatteryProperties>());
+}
+
+Result BatteryPropertyReader::readHook(int64_t* out) {
+    if (config_ == nullptr || config_->energyCounter == nullptr) {
+        return Result::SUCCESS;
+    }
+    int64_t value;
+    if (config_->energyCounter(&value) != 0) {
+        return Result::UNKNOWN;
+    }
+    *out = value;
+    return Result::SUCCESS;
+}
+
+template <size_t I>
+void BatteryPropertyReader::dumpProperty(const HealthSnapshotWriter& snapshot, int fd) {
+    constexpr const auto& d = std::get<I>(kBatteryProperties);
+    BatteryPropertyType<I> value;
+    Result result = read<I>(snapshot, &value);
+    std::string source = "hook";
+    if (d.path != nullptr) {
+        const char* where = "not found, default";
+        if (handles_[I] >= 0) {
+            where = (config_->*d.path).string();
+        } else if (config_ != nullptr && !(config_->*d.path).isEmpty()) {
+            where = "unreadable, default";
+        }
+        source = StringPrintf("%s: %s", d.attr, where);
+    }
+    WriteStringToFd(StringPrintf("  %s: %s (%s)\n", d.name,
+                                 result == Result::SUCCESS ? formatValue(value).c_str()
+                                                           : toString(result).c_str(),
+                                 source.c_str()),
+                    fd);
+}
+
+template <size_t... I>
+void BatteryPropertyReader::dumpProperties(const HealthSnapshotWriter& snapshot, int fd,
+                                           std::index_sequence<I...>) {
+    int expand[] = {(dumpProperty<I>(snapshot, fd), 0)...};
+    (void)expand;
+}
+
+void BatteryPropertyReader::dump(const HealthSnapshotWriter& snapshot, int fd) {
+    WriteStringToFd("\nbattery properties:\n", fd);
+    dumpProperties(snapshot, fd, std::make_index_sequence<kNumBatteryProperties>());
+}
+
+}  // namespace renesas
+}  // namespace V2_0
+}  // namespace health
+}  // namespace hardware
+}  // namespace android
@@ -0,0 +1,227 @@
+/*
+ * Copyright (C) 2018 GlobalLogic
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_HARDWARE_HEALTH_V2_0_RENESAS_HEALTH_PROPERTIES_H
+#define ANDROID_HARDWARE_HEALTH_V2_0_RENESAS_HEALTH_PROPERTIES_H
+
+#include <stdint.h>
+
+#include <array>
+#include <mutex>
+#include <string>
+#include <tuple>
+#include <utility>
+
+#include <android-base/parseint.h>
+#include <android/hardware/health/2.0/types.h>
+#include <batteryservice/BatteryService.h>
+#include <healthd/healthd.h>
+#include <utils/SystemClock.h>
+
+#include <HealthSnapshot.h>
+#include <HealthSnapshotWriter.h>
+#include <SysfsReader.h>
+
+namespace android {
+namespace hardware {
+namespace health {
+namespace V2_0 {
+namespace renesas {
+
+using V1_0::BatteryStatus;
+
+template <typename T>
+inline bool parseInteger(const std::string& s, T* out) {
+    return android::base::ParseInt(s, out);
+}
+
+// Same mapping as BatteryMonitor::getBatteryStatus().
+inline bool parseStatus(const std::string& s, BatteryStatus* out) {
+    static const struct {
+        const char* name;
+        BatteryStatus status;
+    } kStatuses[] = {
+            {"Unknown", BatteryStatus::UNKNOWN},
+            {"Charging", BatteryStatus::CHARGING},
+            {"Discharging", BatteryStatus::DISCHARGING},
+            {"Not charging", BatteryStatus::NOT_CHARGING},
+            {"Full", BatteryStatus::FULL},
+    };
+    for (const auto& entry : kStatuses) {
+        if (s == entry.name) {
+            *out = entry.status;
+            return true;
+        }
+    }
+    return false;
+}
+
+// One battery property served by an IHealth getter.
+template <typename T>
+struct PropertyDescriptor {
+    using Type = T;
+
+    int id;  // BATTERY_PROP_*
+    const char* name;
+    // Sysfs source, or nullptr if the value comes from a healthd_config hook.
+    android::String8 healthd_config::*path;
+    // power_supply attribute BatteryMonitor::init() looks for to set |path|.
+    const char* attr;
+    bool (*parse)(const std::string&, T*);
+    // Sysfs value is multiplied by this to get HAL units.
+    int64_t scale;
+    // Returned when the board has no source for the property.
+    T defaultValue;
+    // A published snapshot younger than this is used instead of a sysfs read;
+    // 0 always reads.
+    int64_t maxAgeMs;
+    // Field of HealthSnapshotData holding the property, or nullptr.
+    int32_t HealthSnapshotData::*snapshotField;
+};
+
+constexpr auto kBatteryProperties = std::make_tuple(
+        PropertyDescriptor<int32_t>{BATTERY_PROP_CHARGE_COUNTER, "chargeCounter",
+                                    &healthd_config::batteryChargeCounterPath, "charge_counter",
+                                    &parseInteger<int32_t>, 1, 1, 1000,
+                                    &HealthSnapshotData::batteryChargeCounter},
+        PropertyDescriptor<int32_t>{BATTERY_PROP_CURRENT_NOW, "currentNow",
+                                    &healthd_config::batteryCurrentNowPath, "current_now",
+                                    &parseInteger<int32_t>, 1, 1, 0,
+                                    &HealthSnapshotData::batteryCurrent},
+        PropertyDescriptor<int32_t>{BATTERY_PROP_CURRENT_AVG, "currentAverage",
+                                    &healthd_config::batteryCurrentAvgPath, "current_avg",
+                                    &parseInteger<int32_t>, 1, 1, 1000,
+                                    &HealthSnapshotData::batteryCurrentAverage},
+        PropertyDescriptor<int32_t>{BATTERY_PROP_CAPACITY, "capacity",
+                                    &healthd_config::batteryCapacityPath, "capacity",
+                                    &parseInteger<int32_t>, 1, 1, 10000,
+                                    &HealthSnapshotData::batteryLevel},
+        PropertyDescriptor<int64_t>{BATTERY_PROP_ENERGY_COUNTER, "energyCounter", nullptr,
+                                    nullptr, &parseInteger<int64_t>, 1, 1, 0, nullptr},
+        PropertyDescriptor<BatteryStatus>{BATTERY_PROP_BATTERY_STATUS, "chargeStatus",
+                                          &healthd_config::batteryStatusPath, "status",
+                                          &parseStatus, 1, BatteryStatus::FULL, 10000,
+                                          &HealthSnapshotData::batteryStatus});
+
+enum BatteryPropertyIndex : size_t {
+    kChargeCounter,
+    kCurrentNow,
+    kCurrentAverage,
+    kCapacity,
+    kEnergyCounter,
+    kChargeStatus,
+    kNumBatteryProperties,
+};
+
+static_assert(std::tuple_size<decltype(kBatteryProperties)>::value == kNumBatteryProperties,
+              "kBatteryProperties and BatteryPropertyIndex out of sync");
+static_assert(std::get<kChargeCounter>(kBatteryProperties).id == BATTERY_PROP_CHARGE_COUNTER &&
+                      std::get<kCurrentNow>(kBatteryProperties).id == BATTERY_PROP_CURRENT_NOW &&
+                      std::get<kCurrentAverage>(kBatteryProperties).id ==
+                              BATTERY_PROP_CURRENT_AVG &&
+                      std::get<kCapacity>(kBatteryProperties).id == BATTERY_PROP_CAPACITY &&
+                      std::get<kEnergyCounter>(kBatteryProperties).id ==
+                              BATTERY_PROP_ENERGY_COUNTER &&
+                      std::get<kChargeStatus>(kBatteryProperties).id ==
+                              BATTERY_PROP_BATTERY_STATUS,
+              "BatteryPropertyIndex does not match BATTERY_PROP_* ids");
+
+template <size_t I>
+using BatteryPropertyType =
+        typename std::tuple_element<I, decltype(kBatteryProperties)>::type::Type;
+
+// Reads the properties of kBatteryProperties. Each read<I>() is a fixed
+// sequence for that property: snapshot check, then one pread() of its cached
+// sysfs fd.
+class BatteryPropertyReader {
+   public:
+    // |config| must already have been through BatteryMonitor::init().
+    void init(struct healthd_config* config);
+
+    template <size_t I>
+    Result read(const HealthSnapshotWriter& snapshot, BatteryPropertyType<I>* out) {
+        constexpr const auto& d = std::get<I>(kBatteryProperties);
+        using T = BatteryPropertyType<I>;
+
+        HealthSnapshotData data;
+        if (d.path != nullptr && handles_[I] >= 0 && d.snapshotField != nullptr &&
+            d.maxAgeMs > 0 && snapshot.read(&data) && data.updateTimeNs != 0 &&
+            elapsedRealtimeNano() - data.updateTimeNs <= d.maxAgeMs * 1000000) {
+            *out = static_cast<T>(data.*d.snapshotField);
+            return Result::SUCCESS;
+        }
+        return readSource<I>(out);
+    }
+
+    // Like read(), but always goes to the property's source.
+    template <size_t I>
+    Result readSource(BatteryPropertyType<I>* out) {
+        constexpr const auto& d = std::get<I>(kBatteryProperties);
+        using T = BatteryPropertyType<I>;
+
+        *out = d.defaultValue;
+        if (d.path == nullptr) {
+            return readHook(out);
+        }
+        if (handles_[I] < 0) {
+            return Result::SUCCESS;
+        }
+
+        std::lock_guard<std::mutex> _lock(lock_);
+        reader_.refresh(handles_[I]);
+        T value;
+        if (!d.parse(reader_.value(handles_[I]), &value)) {
+            return Result::SUCCESS;
+        }
+        *out = scaled(value, d.scale);
+        return Result::SUCCESS;
+    }
+
+    // Writes every property with its source to |fd|.
+    void dump(const HealthSnapshotWriter& snapshot, int fd);
+
+   private:
+    template <typename T>
+    static T scaled(T value, int64_t scale) {
+        return scale == 1 ? value : static_cast<T>(value * scale);
+    }
+    static BatteryStatus scaled(BatteryStatus value, int64_t) { return value; }
+
+    // Properties without a sysfs path; only energyCounter has a hook.
+    template <typename T>
+    Result readHook(T*) {
+        return Result::SUCCESS;
+    }
+    Result readHook(int64_t* out);
+
+    template <size_t... I>
+    void dumpProperties(const HealthSnapshotWriter& snapshot, int fd, std::index_sequence<I...>);
+    template <size_t I>
+    void dumpProperty(const HealthSnapshotWriter& snapshot, int fd);
+
+    struct healthd_config* config_ = nullptr;
+    std::mutex lock_;
+    SysfsReader reader_{SysfsReader::Backend::SYNC};
+    std::array<int, kNumBatteryProperties> handles_;
+};
+
+}  // namespace renesas
+}  // namespace V2_0
+}  // namespace health
+}  // namespace hardware
+}  // namespace android
+
+#endif  // ANDROID_HARDWARE_HEALTH_V2_0_RENESAS_HEALTH_PROPERTIES_H
@@ -17,16 +17,28 @@
 
 #define LOG_TAG "HealthHAL"
 
-#include <fstream>
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <inttypes.h>
+#include <sys/timerfd.h>
 #include <sys/types.h>
 #include <dirent.h>
+#include <unistd.h>
 
+#include <android-base/file.h>
 #include <android-base/logging.h>
+#include <android-base/properties.h>
+#include <android-base/stringprintf.h>
 
 #include <android/hardware/health/1.0/types.h>
 #include <hal_conversion.h>
+#include <EnergyIntegrator.h>
 #include <HealthImpl.h>
+#include <IoRateTracker.h>
+#include <SysfsReader.h>
 #include <healthd/healthd.h>
 #include <hidl/HidlTransportSupport.h>
 #include <hwbinder/IPCThreadState.h>
@@ -35,10 +47,16 @@ using android::hardware::IPCThreadState;
 using android::hardware::configureRpcThreadpool;
 using android::hardware::handleTransportPoll;
 using android::hardware::setupTransportPolling;
+using android::hardware::health::V1_0::BatteryHealth;
+using android::hardware::health::V1_0::BatteryStatus;
+using android::hardware::health::V2_0::DiskStats;
 using android::hardware::health::V2_0::HealthInfo;
 using android::hardware::health::V1_0::hal_conversion::convertToHealthInfo;
 using android::hardware::health::V2_0::IHealth;
+using android::hardware::health::V2_0::renesas::EnergyIntegrator;
 using android::hardware::health::V2_0::renesas::Health;
+using android::hardware::health::V2_0::renesas::IoRateTracker;
+using android::hardware::health::V2_0::renesas::SysfsReader;
 using android::hardware::health::V2_0::StorageAttribute;
 using android::hardware::health::V2_0::StorageInfo;
 
@@ -48,7 +66,18 @@ static const std::string mmc_host_dir_name("/sys/class/mmc_host");
 extern int healthd_main(void);
 
 static int gBinderFd = -1;
+static int gIoStatsFd = -1;
 static std::string gInstanceName;
+static IoRateTracker gIoRateTracker;
+
+static int gEnergyFd = -1;
+static int gEnergyIntervalMs;
+static EnergyIntegrator gEnergyIntegrator;
+
+// Block device counter sampling interval in seconds
+#define DEFAULT_IOSTATS_INTERVAL_S 10
+// Software energy counter sampling interval in milliseconds; 0 disables it
+#define DEFAULT_SW_ENERGY_INTERVAL_MS 0
 
 static void binder_event(uint32_t /*epevents*/) {
     if (gBinderFd >= 0) {
@@ -56,18 +85,117 @@ static void binder_event(uint32_t /*epevents*/) {
     }
 }
 
+static void iostats_event(uint32_t /*epevents*/) {
+    unsigned long long expirations;
+
+    if (read(gIoStatsFd, &expirations, sizeof(expirations)) == -1) {
+        LOG(ERROR) << LOG_TAG << gInstanceName << ": read iostats timer failed";
+        return;
+    }
+    gIoRateTracker.sample();
+}
+
+// Samples block device counters on a CLOCK_MONOTONIC timer, which neither
+// wakes the device nor fires while suspended.
+static void iostats_init() {
+    int interval = android::base::GetIntProperty("ro.vendor.health.iostats_interval_s",
+                                                 DEFAULT_IOSTATS_INTERVAL_S);
+    // get_disk_stats() needs the devices even when sampling is disabled.
+    gIoRateTracker.init(interval > 0 ? interval : DEFAULT_IOSTATS_INTERVAL_S);
+    if (interval <= 0) {
+        return;
+    }
+
+    gIoStatsFd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (gIoStatsFd == -1) {
+        LOG(ERROR) << LOG_TAG << gInstanceName << ": iostats timerfd_create failed";
+        return;
+    }
+    struct itimerspec itval = {
+        .it_interval = {.tv_sec = interval, .tv_nsec = 0},
+        .it_value = {.tv_sec = interval, .tv_nsec = 0},
+    };
+    if (timerfd_settime(gIoStatsFd, 0, &itval, NULL) == -1 ||
+        healthd_register_named_event(gIoStatsFd, iostats_event, EVENT_NO_WAKEUP_FD, "iostats")) {
+        LOG(ERROR) << LOG_TAG << gInstanceName << ": Register for iostats timer failed";
+        return;
+    }
+    gIoRateTracker.sample();
+}
+
+static void energy_event(uint32_t /*epevents*/) {
+    unsigned long long expirations;
+
+    if (read(gEnergyFd, &expirations, sizeof(expirations)) == -1) {
+        LOG(ERROR) << LOG_TAG << gInstanceName << ": read energy timer failed";
+        return;
+    }
+    gEnergyIntegrator.sample();
+}
+
+static int sw_energy_counter(int64_t* energy) {
+    return gEnergyIntegrator.read(energy) ? 0 : -1;
+}
+
+// Plugs the software integrator in as healthd_config::energyCounter when the
+// board has none. Like iostats, the timer is CLOCK_MONOTONIC and registered
+// without EPOLLWAKEUP so sampling never adds a suspend wakeup.
+static void sw_energy_init(struct healthd_config* config) {
+    gEnergyIntervalMs = android::base::GetIntProperty("ro.vendor.health.sw_energy_interval_ms",
+                                                      DEFAULT_SW_ENERGY_INTERVAL_MS);
+    if (gEnergyIntervalMs <= 0 || config->energyCounter != NULL) {
+        return;
+    }
+    if (!gEnergyIntegrator.init(*config, gEnergyIntervalMs)) {
+        LOG(INFO) << LOG_TAG << gInstanceName
+                  << ": no battery current/voltage for software energy counter";
+        return;
+    }
+
+    gEnergyFd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (gEnergyFd == -1) {
+        LOG(ERROR) << LOG_TAG << gInstanceName << ": energy timerfd_create failed";
+        return;
+    }
+    struct timespec interval = {
+        .tv_sec = gEnergyIntervalMs / 1000,
+        .tv_nsec = (gEnergyIntervalMs % 1000) * 1000000L,
+    };
+    struct itimerspec itval = {
+        .it_interval = interval,
+        .it_value = interval,
+    };
+    if (timerfd_settime(gEnergyFd, 0, &itval, NULL) == -1 ||
+        healthd_register_named_event(gEnergyFd, energy_event, EVENT_NO_WAKEUP_FD, "energy")) {
+        LOG(ERROR) << LOG_TAG << gInstanceName << ": Register for energy timer failed";
+        return;
+    }
+    gEnergyIntegrator.sample();
+    config->energyCounter = sw_energy_counter;
+}
+
+void dump_energy_integrator(int fd) {
+    if (gEnergyFd >= 0) {
+        gEnergyIntegrator.dump(fd, gEnergyIntervalMs);
+    }
+}
+
 void healthd_mode_service_2_0_init(struct healthd_config* config) {
     LOG(INFO) << LOG_TAG << gInstanceName << " Hal is starting up...";
 
     gBinderFd = setupTransportPolling();
 
     if (gBinderFd >= 0) {
-        if (healthd_register_event(gBinderFd, binder_event)) {
+        if (healthd_register_named_event(gBinderFd, binder_event, EVENT_NO_WAKEUP_FD, "binder")) {
             LOG(ERROR) << LOG_TAG << gInstanceName << ": Register for binder events failed";
         }
     }
 
+    iostats_init();
+
     android::sp<IHealth> service = Health::initInstance(config);
+    // After initInstance(): needs the battery paths found by BatteryMonitor::init().
+    sw_energy_init(config);
     CHECK_EQ(service->registerAsService(gInstanceName), android::OK)
         << LOG_TAG << gInstanceName << ": Failed to register HAL";
 
@@ -83,10 +211,45 @@ void healthd_mode_service_2_0_heartbeat(void) {
     // noop
 }
 
+template <typename T>
+static void move_to_hidl_vec(std::vector<T>&& from, android::hardware::hidl_vec<T>& to) {
+    to.resize(from.size());
+    std::move(from.begin(), from.end(), to.begin());
+}
+
+// The only place a HealthInfo is built: once per BatteryMonitor::update(),
+// then moved into Health and shared by callbacks, getters and the snapshot.
 void healthd_mode_service_2_0_battery_update(struct android::BatteryProperties* prop) {
     HealthInfo info;
     convertToHealthInfo(prop, info.legacy);
-    Health::getImplementation()->notifyListeners(&info);
+
+    // Boards without a battery or charger power supply run from AC; report
+    // them that way rather than as an empty battery. Only the HealthInfo is
+    // changed: BatteryMonitor keeps seeing no charger, so the periodic chores
+    // stay on the slow interval.
+    auto& legacy = info.legacy;
+    if (!legacy.batteryPresent && !legacy.chargerAcOnline && !legacy.chargerUsbOnline &&
+        !legacy.chargerWirelessOnline) {
+        legacy.chargerAcOnline = true;
+        legacy.maxChargingCurrent = 5000000;
+        legacy.maxChargingVoltage = 12000000;
+        legacy.batteryChargeCounter = 1;
+        legacy.batteryCurrent = 0;
+        legacy.batteryLevel = 0;
+        legacy.batteryStatus = BatteryStatus::UNKNOWN;
+        legacy.batteryHealth = BatteryHealth::UNKNOWN;
+        legacy.batteryTechnology = "AC Power";
+    }
+
+    std::vector<StorageInfo> storage;
+    get_storage_info(storage);
+    move_to_hidl_vec(std::move(storage), info.storageInfos);
+
+    std::vector<DiskStats> stats;
+    get_disk_stats(stats);
+    move_to_hidl_vec(std::move(stats), info.diskStats);
+
+    Health::getImplementation()->notifyListeners(std::move(info));
 }
 
 static struct healthd_mode_ops healthd_mode_service_2_0_ops = {
@@ -103,19 +266,36 @@ int healthd_board_battery_update(struct android::BatteryProperties*) {
     return 0;
 }
 
+// Directories opened by the last find_mmcs(), for the discovery stats.
+static uint64_t gMmcDirsScanned;
+
+// Cost of the MMC discovery in get_storage_info(), kept apart from the
+// SysfsReader counters so those only hold reads the backend made.
+struct DiscoveryStats {
+    uint64_t scans = 0;
+    uint64_t dirs = 0;
+    uint64_t wallNs = 0;
+};
+static DiscoveryStats gDiscoveryStats;
+
 void process_directory(std::string directory, std::vector<std::string>& pathes) {
     std::string dir_to_open = mmc_host_dir_name + "/" + directory;
+    gMmcDirsScanned++;
     auto dir = opendir(dir_to_open.c_str());
+    if (dir == NULL) {
+        return;
+    }
     auto entity = readdir(dir);
     while(entity != NULL) {
         if(strncmp(entity->d_name, "mmc", 3) == 0) {
             std::string name = dir_to_open + "/" + std::string(entity->d_name);
             LOG(DEBUG) << LOG_TAG << " found MMC " << name;
             pathes.push_back(name);
-            return;
+            break;
         }
         entity = readdir(dir);
     }
+    closedir(dir);
 }
 
 void process_entity(struct dirent* entity, std::vector<std::string>& pathes) {
@@ -130,41 +310,76 @@ void process_entity(struct dirent* entity, std::vector<std::string>& pathes) {
 }
 
 bool find_mmcs(std::vector<std::string>& pathes) {
+    gMmcDirsScanned = 1;
     auto dir = opendir(mmc_host_dir_name.c_str());
+    if (dir == NULL) {
+        return true;
+    }
     auto entity = readdir(dir);
     while(entity != NULL) {
         process_entity(entity, pathes);
         entity = readdir(dir);
     }
+    closedir(dir);
     return pathes.size() == 0;
 }
 
-std::string read_file(const std::string& filename) {
-    std::ifstream fs;
-    std::string tmp;
-    fs.open(filename);
-    getline(fs, tmp);
-    fs.close();
-    if (tmp.length() == 0) {
-        LOG(WARNING) << LOG_TAG << " File " << filename << " doesn't exist";
+// Cached sysfs handles for one MMC; see SysfsReader::add().
+struct MmcAttributes {
+    std::string path;
+    int name;
+    int type;
+    int eol;
+    int lifeTime;
+    int rev;
+};
+
+static std::mutex gStorageLock;
+// Set once /sys/class/mmc_host has been scanned; cleared by a block or mmc
+// uevent so that the next get_storage_info() scans again.
+static bool gMmcsDiscovered = false;
+static bool gMmcsMissingLogged = false;
+static std::unique_ptr<SysfsReader> gStorageReader;
+static std::vector<MmcAttributes> gMmcs;
+
+static SysfsReader& storage_reader() {
+    if (!gStorageReader) {
+        gStorageReader = std::make_unique<SysfsReader>();
     }
-    return tmp;
+    return *gStorageReader;
 }
 
-std::string get_mmc_name(const std::string& path) {
-    return read_file(path + "/name");
-}
+// Reopens the attribute files only when the set of MMCs has changed, so that
+// steady-state refreshes are plain re-reads of already open files.
+void open_mmc_attributes(const std::vector<std::string>& pathes) {
+    bool same = pathes.size() == gMmcs.size();
+    for (size_t i = 0; same && i < pathes.size(); ++i) {
+        same = pathes[i] == gMmcs[i].path;
+    }
+    if (same) {
+        return;
+    }
 
-std::string get_mmc_type(const std::string& path) {
-    return read_file(path + "/type");
+    SysfsReader& reader = storage_reader();
+    reader.clear();
+    gMmcs.clear();
+    for (auto& p : pathes) {
+        gMmcs.push_back({
+            .path = p,
+            .name = reader.add(p + "/name"),
+            .type = reader.add(p + "/type"),
+            .eol = reader.add(p + "/pre_eol_info"),
+            .lifeTime = reader.add(p + "/life_time"),
+            .rev = reader.add(p + "/rev"),
+        });
+    }
 }
 
-StorageAttribute get_mmc_attr(const std::string& path) {
+StorageAttribute get_mmc_attr(const std::string& name, const std::string& type) {
     StorageAttribute attr;
 
-    attr.name = get_mmc_name(path);
+    attr.name = name;
 
-    std::string type = get_mmc_type(path);
     if (type.compare("MMC") == 0) {
         attr.isInternal = true;
         attr.isBootDevice = true;
@@ -175,9 +390,8 @@ StorageAttribute get_mmc_attr(const std::string& path) {
     return attr;
 }
 
-uint16_t get_mmc_eol(const std::string& path) {
+uint16_t get_mmc_eol(const std::string& tmp) {
     uint16_t eol {0};
-    std::string tmp = read_file(path + "/pre_eol_info");
 
     if (tmp.length() != 0) {
         eol = std::stoi(tmp, nullptr, 16);
@@ -186,11 +400,10 @@ uint16_t get_mmc_eol(const std::string& path) {
     return eol;
 }
 
-std::pair<uint16_t, uint16_t> get_mmc_lifetime(const std::string& path) {
+std::pair<uint16_t, uint16_t> get_mmc_lifetime(const std::string& tmp) {
     size_t idx {0};
     uint16_t lifetimeA {0};
     uint16_t lifetimeB {0};
-    std::string tmp = read_file(path + "/life_time");
 
     if (tmp.length() != 0) {
         lifetimeA = std::stoi(tmp, &idx, 16);
@@ -200,38 +413,93 @@ std::pair<uint16_t, uint16_t> get_mmc_lifetime(const std::string& path) {
     return {lifetimeA, lifetimeB};
 }
 
-std::string get_mmc_version(const std::string& path) {
-    return read_file(path + "/rev");
-}
-
-StorageInfo get_info(const std::string& path) {
+StorageInfo get_info(const SysfsReader& reader, const MmcAttributes& mmc) {
     StorageInfo si;
 
-    si.attr = get_mmc_attr(path);
-    si.eol = get_mmc_eol(path);
+    si.attr = get_mmc_attr(reader.value(mmc.name), reader.value(mmc.type));
+    si.eol = get_mmc_eol(reader.value(mmc.eol));
 
-    std::pair<uint16_t, uint16_t> life_time = get_mmc_lifetime(path);
+    std::pair<uint16_t, uint16_t> life_time = get_mmc_lifetime(reader.value(mmc.lifeTime));
     si.lifetimeA = life_time.first;
     si.lifetimeB = life_time.second;
 
-    si.version = get_mmc_version(path);
+    si.version = reader.value(mmc.rev);
 
     return si;
 }
 
 void get_storage_info(std::vector<StorageInfo>& v) {
-    std::vector<std::string> mmc_pathes;
-    if (find_mmcs(mmc_pathes)) {
-        LOG(ERROR) << LOG_TAG << " MMC Read ERROR!";
+    std::lock_guard<std::mutex> lock(gStorageLock);
+
+    if (!gMmcsDiscovered) {
+        auto start = std::chrono::steady_clock::now();
+        std::vector<std::string> mmc_pathes;
+        bool missing = find_mmcs(mmc_pathes);
+        gDiscoveryStats.scans++;
+        gDiscoveryStats.dirs += gMmcDirsScanned;
+        gDiscoveryStats.wallNs += std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                          std::chrono::steady_clock::now() - start)
+                                          .count();
+        gMmcsDiscovered = true;
+
+        if (missing && !gMmcsMissingLogged) {
+            LOG(WARNING) << LOG_TAG << " no MMC found, storage info not reported";
+        }
+        gMmcsMissingLogged = missing;
+        open_mmc_attributes(mmc_pathes);
+    }
+    if (gMmcs.empty()) {
         return;
     }
-    for(auto& p : mmc_pathes) {
-        StorageInfo si = get_info(p);
-        v.push_back(si);
+
+    // All attributes of all MMCs are read in one refresh.
+    SysfsReader& reader = storage_reader();
+    reader.refresh();
+    for (auto& mmc : gMmcs) {
+        v.push_back(get_info(reader, mmc));
     }
 }
-void get_disk_stats(std::vector<struct DiskStats>&) {
-    // ...
+
+void invalidate_storage_devices() {
+    std::lock_guard<std::mutex> lock(gStorageLock);
+    gMmcsDiscovered = false;
+}
+
+void dump_storage_stats(int fd) {
+    std::lock_guard<std::mutex> lock(gStorageLock);
+    android::base::WriteStringToFd("\nstorage sysfs reads:\n", fd);
+    storage_reader().dumpStats(fd);
+
+    const DiscoveryStats& d = gDiscoveryStats;
+    if (d.scans == 0) {
+        return;
+    }
+    // opendir/readdir/closedir go through libc buffering, so syscalls are only
+    // estimated: an open, usually two getdents64 and a close per directory.
+    android::base::WriteStringToFd(
+            android::base::StringPrintf("  discovery: scans=%" PRIu64 " avg_dirs=%.1f"
+                                        " avg_wall_us=%.1f est_syscalls~%.1f (estimate)\n",
+                                        d.scans, static_cast<double>(d.dirs) / d.scans,
+                                        d.wallNs / 1000.0 / d.scans,
+                                        4.0 * d.dirs / d.scans),
+            fd);
+}
+
+bool set_storage_sysfs_backend(const std::string& name) {
+    SysfsReader::Backend backend;
+    if (!SysfsReader::parseBackend(name, &backend)) {
+        return false;
+    }
+    std::lock_guard<std::mutex> lock(gStorageLock);
+    return storage_reader().setBackend(backend);
+}
+
+void get_disk_stats(std::vector<struct DiskStats>& stats) {
+    gIoRateTracker.readStats(stats);
+}
+
+void dump_io_rates(int fd) {
+    gIoRateTracker.dump(fd);
 }
 
 int main()
@@ -0,0 +1,144 @@
+/*
+ * Copyright (C) 2018 GlobalLogic
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_HARDWARE_HEALTH_V2_0_RENESAS_HEALTH_SNAPSHOT_H
+#define ANDROID_HARDWARE_HEALTH_V2_0_RENESAS_HEALTH_SNAPSHOT_H
+
+// Layout of the read-only shared memory region in which the health service
+// publishes its latest HealthInfo. This header has no HIDL dependencies so
+// that local clients can include it directly.
+//
+// A client obtains the region fd by calling IHealth::debug() with a unix
+// socket as the handle and "--snapshot-fd" as the only argument; a read-only
+// fd is sent back over that socket as SCM_RIGHTS, or nothing if the service
+// could not seal the region. The client then maps it with
+// mmap(nullptr, sizeof(HealthSnapshotRegion), PROT_READ, MAP_SHARED, fd, 0)
+// and calls ReadHealthSnapshot() whenever it needs fresh values.
+
+#include <stdint.h>
+#include <string.h>
+
+#include <atomic>
+
+namespace android {
+namespace hardware {
+namespace health {
+namespace V2_0 {
+namespace renesas {
+
+static constexpr uint32_t kHealthSnapshotMagic = 0x48534e50;  // "HSNP"
+static constexpr uint32_t kHealthSnapshotVersion = 1;
+
+static constexpr size_t kSnapshotMaxStorageInfos = 4;
+static constexpr size_t kSnapshotMaxDiskStats = 4;
+static constexpr size_t kSnapshotNameLen = 32;
+
+struct HealthSnapshotStorageInfo {
+    char name[kSnapshotNameLen];
+    char version[kSnapshotNameLen];
+    uint8_t isInternal;
+    uint8_t isBootDevice;
+    uint16_t eol;
+    uint16_t lifetimeA;
+    uint16_t lifetimeB;
+};
+
+struct HealthSnapshotDiskStats {
+    char name[kSnapshotNameLen];
+    uint64_t reads;
+    uint64_t readMerges;
+    uint64_t readSectors;
+    uint64_t readTicks;
+    uint64_t writes;
+    uint64_t writeMerges;
+    uint64_t writeSectors;
+    uint64_t writeTicks;
+    uint64_t ioInFlight;
+    uint64_t ioTicks;
+    uint64_t ioInQueue;
+};
+
+// Mirrors V2_0::HealthInfo with fixed-size arrays. Enums are stored as their
+// underlying V1_0 values.
+struct HealthSnapshotData {
+    // CLOCK_BOOTTIME of the update this data comes from; 0 if never published.
+    int64_t updateTimeNs;
+
+    uint8_t chargerAcOnline;
+    uint8_t chargerUsbOnline;
+    uint8_t chargerWirelessOnline;
+    uint8_t batteryPresent;
+    int32_t maxChargingCurrent;
+    int32_t maxChargingVoltage;
+    int32_t batteryStatus;
+    int32_t batteryHealth;
+    int32_t batteryLevel;
+    int32_t batteryVoltage;
+    int32_t batteryTemperature;
+    int32_t batteryCurrent;
+    int32_t batteryCycleCount;
+    int32_t batteryFullCharge;
+    int32_t batteryChargeCounter;
+    int32_t batteryCurrentAverage;
+    char batteryTechnology[kSnapshotNameLen];
+
+    uint32_t numStorageInfos;
+    uint32_t numDiskStats;
+    HealthSnapshotStorageInfo storageInfos[kSnapshotMaxStorageInfos];
+    HealthSnapshotDiskStats diskStats[kSnapshotMaxDiskStats];
+};
+
+struct HealthSnapshotRegion {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t size;
+    // Odd while the service is writing |data|.
+    std::atomic<uint32_t> seq;
+    HealthSnapshotData data;
+};
+
+static_assert(std::atomic<uint32_t>::is_always_lock_free, "seqlock must be lock-free");
+
+// Copies the latest consistent snapshot into |out|. Returns false if the
+// region is not a compatible snapshot or the writer kept it busy for
+// |maxRetries| attempts.
+inline bool ReadHealthSnapshot(const HealthSnapshotRegion* region, HealthSnapshotData* out,
+                               int maxRetries = 100) {
+    if (region->magic != kHealthSnapshotMagic || region->version != kHealthSnapshotVersion ||
+        region->size != sizeof(HealthSnapshotRegion)) {
+        return false;
+    }
+    for (int i = 0; i < maxRetries; ++i) {
+        uint32_t begin = region->seq.load(std::memory_order_acquire);
+        if (begin & 1) {
+            continue;
+        }
+        memcpy(out, &region->data, sizeof(*out));
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (region->seq.load(std::memory_order_relaxed) == begin) {
+            return true;
+        }
+    }
+    return false;
+}
+
+}  // namespace renesas
+}  // namespace V2_0
+}  // namespace health
+}  // namespace hardware
+}  // namespace android
+
+#endif  // ANDROID_HARDWARE_HEALTH_V2_0_RENESAS_HEALTH_SNAPSHOT_H
@@ -0,0 +1,207 @@
+/*
+ * Copyright (C) 2018 GlobalLogic
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "android.hardware.health@2.0-impl"
+
+#include <HealthSnapshotWriter.h>
+
+#include <fcntl.h>
+#include <linux/memfd.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <new>
+#include <string>
+
+#include <android-base/logging.h>
+#include <utils/SystemClock.h>
+
+// Seals from newer uapi headers than the platform may ship.
+#ifndef F_ADD_SEALS
+#define F_ADD_SEALS (1024 + 9)
+#endif
+#ifndef F_SEAL_SHRINK
+#define F_SEAL_SHRINK 0x0002
+#define F_SEAL_GROW 0x0004
+#endif
+#ifndef F_SEAL_FUTURE_WRITE
+#define F_SEAL_FUTURE_WRITE 0x0010
+#endif
+
+namespace android {
+namespace hardware {
+namespace health {
+namespace V2_0 {
+namespace renesas {
+
+HealthSnapshotWriter::~HealthSnapshotWriter() {
+    if (region_ != nullptr) {
+        munmap(region_, sizeof(*region_));
+    }
+}
+
+bool HealthSnapshotWriter::init() {
+    fd_.reset(static_cast<int>(
+            syscall(__NR_memfd_create, "health_snapshot", MFD_CLOEXEC | MFD_ALLOW_SEALING)));
+    if (fd_ < 0) {
+        PLOG(ERROR) << "health snapshot: memfd_create failed";
+        return false;
+    }
+    if (ftruncate(fd_, sizeof(HealthSnapshotRegion)) == -1) {
+        PLOG(ERROR) << "health snapshot: ftruncate failed";
+        fd_.reset();
+        return false;
+    }
+
+    void* addr = mmap(nullptr, sizeof(HealthSnapshotRegion), PROT_READ | PROT_WRITE, MAP_SHARED,
+                      fd_, 0);
+    if (addr == MAP_FAILED) {
+        PLOG(ERROR) << "health snapshot: mmap failed";
+        fd_.reset();
+        return false;
+    }
+    region_ = new (addr) HealthSnapshotRegion();
+    region_->magic = kHealthSnapshotMagic;
+    region_->version = kHealthSnapshotVersion;
+    region_->size = sizeof(HealthSnapshotRegion);
+    region_->seq.store(0, std::memory_order_release);
+
+    // Our own mapping stays writable. Clients only ever get a read-only
+    // descriptor, and only once the region is sealed against new writable
+    // mappings, so neither the fd nor a reopen of it can be used to write.
+    if (fcntl(fd_, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW) == -1 ||
+        fcntl(fd_, F_ADD_SEALS, F_SEAL_FUTURE_WRITE) == -1) {
+        PLOG(WARNING) << "health snapshot: cannot seal region, not sharing it with clients";
+        return true;
+    }
+    std::string path = "/proc/self/fd/" + std::to_string(fd_.get());
+    read_only_fd_.reset(TEMP_FAILURE_RETRY(open(path.c_str(), O_RDONLY | O_CLOEXEC)));
+    if (read_only_fd_ < 0) {
+        PLOG(WARNING) << "health snapshot: cannot reopen region read-only, not sharing it";
+    }
+    return true;
+}
+
+static void copyString(char* dst, const hidl_string& src) {
+    strlcpy(dst, src.c_str(), kSnapshotNameLen);
+}
+
+void HealthSnapshotWriter::publish(const HealthInfo& info) {
+    if (region_ == nullptr) {
+        return;
+    }
+
+    uint32_t seq = region_->seq.load(std::memory_order_relaxed);
+    region_->seq.store(seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    HealthSnapshotData& d = region_->data;
+    const V1_0::HealthInfo& legacy = info.legacy;
+    d.updateTimeNs = elapsedRealtimeNano();
+    d.chargerAcOnline = legacy.chargerAcOnline;
+    d.chargerUsbOnline = legacy.chargerUsbOnline;
+    d.chargerWirelessOnline = legacy.chargerWirelessOnline;
+    d.batteryPresent = legacy.batteryPresent;
+    d.maxChargingCurrent = legacy.maxChargingCurrent;
+    d.maxChargingVoltage = legacy.maxChargingVoltage;
+    d.batteryStatus = static_cast<int32_t>(legacy.batteryStatus);
+    d.batteryHealth = static_cast<int32_t>(legacy.batteryHealth);
+    d.batteryLevel = legacy.batteryLevel;
+    d.batteryVoltage = legacy.batteryVoltage;
+    d.batteryTemperature = legacy.batteryTemperature;
+    d.batteryCurrent = legacy.batteryCurrent;
+    d.batteryCycleCount = legacy.batteryCycleCount;
+    d.batteryFullCharge = legacy.batteryFullCharge;
+    d.batteryChargeCounter = legacy.batteryChargeCounter;
+    d.batteryCurrentAverage = info.batteryCurrentAverage;
+    copyString(d.batteryTechnology, legacy.batteryTechnology);
+
+    d.numStorageInfos = std::min(info.storageInfos.size(), kSnapshotMaxStorageInfos);
+    for (size_t i = 0; i < d.numStorageInfos; ++i) {
+        const StorageInfo& src = info.storageInfos[i];
+        HealthSnapshotStorageInfo& dst = d.storageInfos[i];
+        copyString(dst.name, src.attr.name);
+        copyString(dst.version, src.version);
+        dst.isInternal = src.attr.isInternal;
+        dst.isBootDevice = src.attr.isBootDevice;
+        dst.eol = src.eol;
+        dst.lifetimeA = src.lifetimeA;
+        dst.lifetimeB = src.lifetimeB;
+    }
+
+    d.numDiskStats = std::min(info.diskStats.size(), kSnapshotMaxDiskStats);
+    for (size_t i = 0; i < d.numDiskStats; ++i) {
+        const DiskStats& src = info.diskStats[i];
+        HealthSnapshotDiskStats& dst = d.diskStats[i];
+        copyString(dst.name, src.attr.name);
+        dst.reads = src.reads;
+        dst.readMerges = src.readMerges;
+        dst.readSectors = src.readSectors;
+        dst.readTicks = src.readTicks;
+        dst.writes = src.writes;
+        dst.writeMerges = src.writeMerges;
+        dst.writeSectors = src.writeSectors;
+        dst.writeTicks = src.writeTicks;
+        dst.ioInFlight = src.ioInFlight;
+        dst.ioTicks = src.ioTicks;
+        dst.ioInQueue = src.ioInQueue;
+    }
+
+    region_->seq.store(seq + 2, std::memory_order_release);
+}
+
+bool HealthSnapshotWriter::read(HealthSnapshotData* out) const {
+    return region_ != nullptr && ReadHealthSnapshot(region_, out);
+}
+
+bool HealthSnapshotWriter::sendFd(int sock) const {
+    if (read_only_fd_ < 0) {
+        LOG(WARNING) << "health snapshot: region is not sealed, refusing to share it";
+        return false;
+    }
+
+    char tag = 'S';
+    struct iovec iov = {.iov_base = &tag, .iov_len = sizeof(tag)};
+    char control[CMSG_SPACE(sizeof(int))] = {};
+    struct msghdr msg = {};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+
+    struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+    int fd = read_only_fd_.get();
+    memcpy(CMSG_DATA(cmsg), &fd, sizeof(fd));
+
+    if (TEMP_FAILURE_RETRY(sendmsg(sock, &msg, MSG_NOSIGNAL)) == -1) {
+        PLOG(WARNING) << "health snapshot: cannot send region fd";
+        return false;
+    }
+    return true;
+}
+
+}  // namespace renesas
+}  // namespace V2_0
+}  // namespace health
+}  // namespace hardware
+}  // namespace android
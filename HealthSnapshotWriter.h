@@ -0,0 +1,60 @@
+/*
+ * Copyright (C) 2018 GlobalLogic
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_HARDWARE_HEALTH_V2_0_RENESAS_HEALTH_SNAPSHOT_WRITER_H
+#define ANDROID_HARDWARE_HEALTH_V2_0_RENESAS_HEALTH_SNAPSHOT_WRITER_H
+
+#include <android-base/unique_fd.h>
+#include <android/hardware/health/2.0/types.h>
+
+#include <HealthSnapshot.h>
+
+namespace android {
+namespace hardware {
+namespace health {
+namespace V2_0 {
+namespace renesas {
+
+// Service side of HealthSnapshot.h: owns the memfd and the only writable
+// mapping of it. publish() may be called from any thread but calls must not
+// overlap.
+class HealthSnapshotWriter {
+   public:
+    HealthSnapshotWriter() = default;
+    ~HealthSnapshotWriter();
+
+    bool init();
+    void publish(const HealthInfo& info);
+    // Latest published data, read through the same seqlock as clients.
+    bool read(HealthSnapshotData* out) const;
+    // Sends a read-only fd of the region over the unix socket |sock|. Fails if
+    // init() could not seal the region.
+    bool sendFd(int sock) const;
+
+   private:
+    android::base::unique_fd fd_;
+    // Reopened O_RDONLY after sealing; the only descriptor given to clients.
+    android::base::unique_fd read_only_fd_;
+    HealthSnapshotRegion* region_ = nullptr;
+};
+
+}  // namespace renesas
+}  // namespace V2_0
+}  // namespace health
+}  // namespace hardware
+}  // namespace android
+
+#endif  // ANDROID_HARDWARE_HEALTH_V2_0_RENESAS_HEALTH_SNAPSHOT_WRITER_H
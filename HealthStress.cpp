@@ -0,0 +1,304 @@
+/*
+ * Copyright (C) 2018 GlobalLogic
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "android.hardware.health@2.0-impl"
+
+#include <HealthStress.h>
+
+#include <inttypes.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <android-base/file.h>
+#include <android-base/logging.h>
+#include <android-base/parseint.h>
+#include <android-base/stringprintf.h>
+
+using android::base::StringPrintf;
+using android::base::WriteStringToFd;
+using std::chrono::steady_clock;
+
+namespace android {
+namespace hardware {
+namespace health {
+namespace V2_0 {
+namespace renesas {
+
+namespace {
+
+int64_t nowNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                   steady_clock::now().time_since_epoch())
+            .count();
+}
+
+// Latencies go into fixed log2 histograms, so memory stays constant however
+// many deliveries a run makes and the report needs no sort.
+std::string latencyLine(const char* what, const LockHoldStats& stats) {
+    uint64_t n = stats.count.load();
+    return StringPrintf("%s: n=%" PRIu64 " mean=%.1fus p50<=%.1fus p90<=%.1fus p99<=%.1fus "
+                        "max=%.1fus\n",
+                        what, n, n ? stats.totalNs.load() / 1000.0 / n : 0.0,
+                        stats.percentileNs(0.5) / 1000.0, stats.percentileNs(0.9) / 1000.0,
+                        stats.percentileNs(0.99) / 1000.0, stats.maxNs.load() / 1000.0);
+}
+
+class FakeHealthInfoCallback : public IHealthInfoCallback {
+   public:
+    enum class Mode { OK, FAIL, DEAD };
+
+    FakeHealthInfoCallback(Mode mode, uint32_t latencyUs, const std::atomic<int64_t>* notifyStartNs,
+                           LockHoldStats* latencies)
+        : mode_(mode),
+          latency_us_(latencyUs),
+          notify_start_ns_(notifyStartNs),
+          latencies_(latencies) {}
+
+    Return<void> healthInfoChanged(const HealthInfo&) override {
+        int64_t start = notify_start_ns_->load(std::memory_order_relaxed);
+        if (start != 0) {
+            latencies_->record(nowNs() - start);
+        }
+        if (latency_us_ != 0) {
+            usleep(latency_us_);
+        }
+        switch (mode_) {
+            case Mode::FAIL:
+                return Status::fromExceptionCode(Status::EX_TRANSACTION_FAILED);
+            case Mode::DEAD:
+                return Status::fromStatusT(DEAD_OBJECT);
+            case Mode::OK:
+                break;
+        }
+        return Void();
+    }
+
+   private:
+    const Mode mode_;
+    const uint32_t latency_us_;
+    const std::atomic<int64_t>* notify_start_ns_;
+    LockHoldStats* latencies_;
+};
+
+}  // namespace
+
+bool parseStressArgs(const hidl_vec<hidl_string>& args, StressConfig* config,
+                     std::string* error) {
+    static const struct {
+        const char* key;
+        uint32_t StressConfig::*field;
+        uint32_t max;
+    } kKeys[] = {
+            {"callbacks", &StressConfig::callbacks, 1000},
+            {"latency_us", &StressConfig::latency_us, 100000},
+            {"slow", &StressConfig::slow, 1000},
+            {"slow_latency_us", &StressConfig::slow_latency_us, 100000},
+            {"failing", &StressConfig::failing, 1000},
+            {"dead", &StressConfig::dead, 1000},
+            {"update_hz", &StressConfig::update_hz, 100},
+            {"getter_threads", &StressConfig::getter_threads, 16},
+            {"duration_ms", &StressConfig::duration_ms, 60000},
+    };
+
+    for (size_t i = 1; i < args.size(); ++i) {
+        std::string arg(args[i]);
+        size_t eq = arg.find('=');
+        if (eq == std::string::npos) {
+            *error = "expected key=value, got \"" + arg + "\"";
+            return false;
+        }
+        std::string key = arg.substr(0, eq);
+        auto it = std::find_if(std::begin(kKeys), std::end(kKeys),
+                               [&key](const auto& k) { return key == k.key; });
+        if (it == std::end(kKeys)) {
+            *error = "unknown key \"" + key + "\"";
+            return false;
+        }
+        if (!android::base::ParseUint(arg.substr(eq + 1), &(config->*(it->field)), it->max)) {
+            *error = StringPrintf("%s must be a number <= %u", it->key, it->max);
+            return false;
+        }
+    }
+
+    if (config->update_hz == 0) {
+        *error = "update_hz must be > 0";
+        return false;
+    }
+    if (config->slow + config->failing + config->dead > config->callbacks) {
+        *error = StringPrintf("slow + failing + dead (%u) exceeds callbacks (%u)",
+                              config->slow + config->failing + config->dead, config->callbacks);
+        return false;
+    }
+    // A single fan-out must not hold the main loop much longer than the run.
+    // Only the slow callbacks sleep for slow_latency_us.
+    uint64_t fanOutUs =
+            static_cast<uint64_t>(config->callbacks - config->slow) * config->latency_us +
+            static_cast<uint64_t>(config->slow) * config->slow_latency_us;
+    if (fanOutUs > static_cast<uint64_t>(config->duration_ms) * 1000) {
+        *error = StringPrintf("one fan-out takes %" PRIu64 "ms, longer than duration_ms (%u)",
+                              fanOutUs / 1000, config->duration_ms);
+        return false;
+    }
+    return true;
+}
+
+void runStress(const sp<Health>& health, const StressConfig& config, int fd) {
+    WriteStringToFd(StringPrintf("stress: callbacks=%u (slow=%u failing=%u dead=%u) latency_us=%u "
+                                 "update_hz=%u getter_threads=%u duration_ms=%u\n",
+                                 config.callbacks, config.slow, config.failing, config.dead,
+                                 config.latency_us, config.update_hz, config.getter_threads,
+                                 config.duration_ms),
+                    fd);
+
+    std::atomic<int64_t> notifyStartNs{0};
+    LockHoldStats deliveries;
+    LockHoldStats updates;
+    LockHoldStats registrations;
+
+    std::vector<sp<FakeHealthInfoCallback>> callbacks;
+    std::vector<sp<FakeHealthInfoCallback>> dead;
+    for (uint32_t i = 0; i < config.callbacks; ++i) {
+        auto mode = FakeHealthInfoCallback::Mode::OK;
+        uint32_t latency = config.latency_us;
+        if (i < config.dead) {
+            mode = FakeHealthInfoCallback::Mode::DEAD;
+        } else if (i < config.dead + config.failing) {
+            mode = FakeHealthInfoCallback::Mode::FAIL;
+        } else if (i < config.dead + config.failing + config.slow) {
+            latency = config.slow_latency_us;
+        }
+        callbacks.push_back(new FakeHealthInfoCallback(mode, latency, &notifyStartNs, &deliveries));
+        if (mode == FakeHealthInfoCallback::Mode::DEAD) {
+            dead.push_back(callbacks.back());
+        }
+    }
+
+    // Real clients must neither see the harness updates nor be part of the
+    // measured fan-out; they are put back, and brought up to date, at the end.
+    auto clients = health->detachCallbacks();
+    size_t heldBack = clients.size();
+    health->callbackLockStats().reset();
+
+    auto runStart = steady_clock::now();
+    for (auto& cb : callbacks) {
+        auto start = steady_clock::now();
+        health->registerCallback(cb);
+        registrations.record(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                     steady_clock::now() - start)
+                                     .count());
+    }
+    int64_t registerMs = std::chrono::duration_cast<std::chrono::milliseconds>(
+                              steady_clock::now() - runStart)
+                              .count();
+    // Only deliveries caused by the timed updates below are measured.
+    deliveries.reset();
+
+    auto loadStart = steady_clock::now();
+    auto deadline = loadStart + std::chrono::milliseconds(config.duration_ms);
+    std::atomic<uint64_t> getterCalls{0};
+    uint64_t updateCount = 0;
+    uint64_t missedTicks = 0;
+
+    std::vector<std::thread> threads;
+    for (uint32_t t = 0; t < config.getter_threads; ++t) {
+        threads.emplace_back([&health, &getterCalls, deadline] {
+            while (steady_clock::now() < deadline) {
+                health->getCapacity([](auto, auto) {});
+                health->getChargeStatus([](auto, auto) {});
+                health->getHealthInfo([](auto, const auto&) {});
+                health->getStorageInfo([](auto, const auto&) {});
+                getterCalls.fetch_add(4, std::memory_order_relaxed);
+            }
+        });
+    }
+
+    // Clients that reported DEAD_OBJECT also get their death notification
+    // half way through, racing with the update loop.
+    threads.emplace_back([&health, &dead, &config] {
+        std::this_thread::sleep_for(std::chrono::milliseconds(config.duration_ms / 2));
+        for (auto& cb : dead) {
+            health->serviceDied(0u, cb);
+        }
+    });
+
+    auto period = std::chrono::nanoseconds(1000000000ull / config.update_hz);
+    auto next = steady_clock::now();
+    while (steady_clock::now() < deadline) {
+        auto start = steady_clock::now();
+        notifyStartNs.store(nowNs(), std::memory_order_relaxed);
+        // Every tick must run an update of its own; update() would join the
+        // one from the previous tick inside the coalescing window.
+        health->requestUpdate(std::chrono::milliseconds(0));
+        notifyStartNs.store(0, std::memory_order_relaxed);
+        updates.record(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                               steady_clock::now() - start)
+                               .count());
+        ++updateCount;
+
+        next += period;
+        auto now = steady_clock::now();
+        if (next < now) {
+            missedTicks++;
+            next = now;
+        }
+        std::this_thread::sleep_until(next);
+    }
+
+    for (auto& t : threads) {
+        t.join();
+    }
+    double seconds = std::chrono::duration<double>(steady_clock::now() - loadStart).count();
+
+    for (auto& cb : callbacks) {
+        health->unregisterCallback(cb);
+    }
+    health->reattachCallbacks(std::move(clients));
+
+    const LockHoldStats& lock = health->callbackLockStats();
+    uint64_t lockCount = lock.count.load();
+    WriteStringToFd(StringPrintf("registered clients held back: %zu\n", heldBack), fd);
+    WriteStringToFd(StringPrintf("registerCallback: total=%" PRId64 "ms\n", registerMs), fd);
+    WriteStringToFd(latencyLine("  per call", registrations), fd);
+    WriteStringToFd(StringPrintf("updates: %" PRIu64 " calls, %.1f/s achieved, %" PRIu64
+                                 " missed ticks\n",
+                                 updateCount, updateCount / seconds, missedTicks),
+                    fd);
+    WriteStringToFd(latencyLine("  per call", updates), fd);
+    WriteStringToFd(latencyLine("notify delivery (update start -> callback)", deliveries),
+                    fd);
+    WriteStringToFd(StringPrintf("callbacks_lock_ hold: n=%" PRIu64 " mean=%.1fus p50<=%.1fus "
+                                 "p99<=%.1fus max=%.1fus\n",
+                                 lockCount,
+                                 lockCount ? lock.totalNs.load() / 1000.0 / lockCount : 0.0,
+                                 lock.percentileNs(0.5) / 1000.0, lock.percentileNs(0.99) / 1000.0,
+                                 lock.maxNs.load() / 1000.0),
+                    fd);
+    WriteStringToFd(StringPrintf("getters: %" PRIu64 " calls, %.0f/s\n", getterCalls.load(),
+                                 getterCalls.load() / seconds),
+                    fd);
+}
+
+}  // namespace renesas
+}  // namespace V2_0
+}  // namespace health
+}  // namespace hardware
+}  // namespace android
@@ -0,0 +1,71 @@
+/*
+ * Copyright (C) 2018 GlobalLogic
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_HARDWARE_HEALTH_V2_0_RENESAS_HEALTH_STRESS_H
+#define ANDROID_HARDWARE_HEALTH_V2_0_RENESAS_HEALTH_STRESS_H
+
+#include <stdint.h>
+
+#include <string>
+
+#include <HealthImpl.h>
+
+namespace android {
+namespace hardware {
+namespace health {
+namespace V2_0 {
+namespace renesas {
+
+// In-process stress run of the callback fan-out, started with
+//   lshal debug android.hardware.health@2.0::IHealth/default --stress [key=value ...]
+// Every field below can be set by its key, up to the limit in
+// parseStressArgs(). The run blocks the main loop for |duration_ms|, so
+// debug() only accepts it on ro.debuggable builds. Callbacks registered by
+// real clients are detached for the run and get the latest HealthInfo after.
+struct StressConfig {
+    // Fake IHealthInfoCallback clients to register.
+    uint32_t callbacks = 100;
+    // Delay of every healthInfoChanged().
+    uint32_t latency_us = 0;
+    // Of |callbacks|, how many are slow, how many return a transport error
+    // and how many report DEAD_OBJECT and are later reported via serviceDied().
+    uint32_t slow = 0;
+    uint32_t slow_latency_us = 10000;
+    uint32_t failing = 0;
+    uint32_t dead = 0;
+    // Target rate of updates, each running BatteryMonitor::update(), and
+    // number of threads calling getters.
+    uint32_t update_hz = 10;
+    uint32_t getter_threads = 2;
+    uint32_t duration_ms = 5000;
+};
+
+// Parses args[1..] as key=value pairs. Returns false, with the reason in
+// |error|, on unknown keys, values over their limit, or a fan-out that could
+// outlast the run.
+bool parseStressArgs(const hidl_vec<hidl_string>& args, StressConfig* config,
+                     std::string* error);
+
+// Runs the harness against |health| and writes the report to |fd|.
+void runStress(const sp<Health>& health, const StressConfig& config, int fd);
+
+}  // namespace renesas
+}  // namespace V2_0
+}  // namespace health
+}  // namespace hardware
+}  // namespace android
+
+#endif  // ANDROID_HARDWARE_HEALTH_V2_0_RENESAS_HEALTH_STRESS_H
@@ -0,0 +1,216 @@
+/*
+ * Copyright (C) 2018 GlobalLogic
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "HealthHAL"
+
+#include <IoRateTracker.h>
+
+#include <ctype.h>
+#include <dirent.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+
+#include <android-base/file.h>
+#include <android-base/logging.h>
+#include <android-base/stringprintf.h>
+#include <utils/SystemClock.h>
+
+using android::base::StringPrintf;
+using android::base::WriteStringToFd;
+
+namespace android {
+namespace hardware {
+namespace health {
+namespace V2_0 {
+namespace renesas {
+
+static const std::string block_dir_name("/sys/block");
+static constexpr uint64_t kSectorSize = 512;
+
+constexpr int IoRateTracker::kWindowSeconds[];
+
+// Whole MMC devices only: mmcblk0, not mmcblk0boot0 or mmcblk0rpmb.
+static bool is_mmc_disk(const char* name) {
+    if (strncmp(name, "mmcblk", 6) != 0 || name[6] == '\0') {
+        return false;
+    }
+    for (const char* p = name + 6; *p; ++p) {
+        if (!isdigit(*p)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void IoRateTracker::init(int intervalSeconds) {
+    std::lock_guard<std::mutex> _lock(lock_);
+    interval_seconds_ = intervalSeconds;
+    reader_.clear();
+    devices_.clear();
+
+    auto dir = opendir(block_dir_name.c_str());
+    if (dir == NULL) {
+        LOG(ERROR) << LOG_TAG << " cannot open " << block_dir_name;
+        return;
+    }
+    size_t slots = kWindowSeconds[kNumWindows - 1] / intervalSeconds + 1;
+    for (auto entity = readdir(dir); entity != NULL; entity = readdir(dir)) {
+        if (!is_mmc_disk(entity->d_name)) {
+            continue;
+        }
+        std::string path = block_dir_name + "/" + entity->d_name;
+        int stat = reader_.add(path + "/stat");
+        if (stat < 0) {
+            continue;
+        }
+
+        Device device;
+        device.attr.name = entity->d_name;
+        std::string type;
+        android::base::ReadFileToString(path + "/device/type", &type);
+        device.attr.isInternal = type.compare(0, 3, "MMC") == 0;
+        device.attr.isBootDevice = device.attr.isInternal;
+        device.stat = stat;
+        device.ring.resize(slots);
+        LOG(DEBUG) << LOG_TAG << " tracking I/O of " << path;
+        devices_.push_back(std::move(device));
+    }
+    closedir(dir);
+}
+
+bool IoRateTracker::parse(const Device& device, DiskStats* out) const {
+    const std::string& line = reader_.value(device.stat);
+    DiskStats stats;
+    if (sscanf(line.c_str(),
+               "%" SCNu64 " %" SCNu64 " %" SCNu64 " %" SCNu64 " %" SCNu64 " %" SCNu64
+               " %" SCNu64 " %" SCNu64 " %" SCNu64 " %" SCNu64 " %" SCNu64,
+               &stats.reads, &stats.readMerges, &stats.readSectors, &stats.readTicks,
+               &stats.writes, &stats.writeMerges, &stats.writeSectors, &stats.writeTicks,
+               &stats.ioInFlight, &stats.ioTicks, &stats.ioInQueue) != 11) {
+        return false;
+    }
+    stats.attr = device.attr;
+    *out = std::move(stats);
+    return true;
+}
+
+void IoRateTracker::readStats(std::vector<DiskStats>& stats) {
+    std::lock_guard<std::mutex> _lock(lock_);
+    reader_.refresh();
+    for (const auto& device : devices_) {
+        DiskStats s;
+        if (parse(device, &s)) {
+            stats.push_back(std::move(s));
+        }
+    }
+}
+
+void IoRateTracker::sample() {
+    std::lock_guard<std::mutex> _lock(lock_);
+    reader_.refresh();
+    int64_t now = elapsedRealtime();
+    for (auto& device : devices_) {
+        DiskStats s;
+        if (!parse(device, &s)) {
+            continue;
+        }
+        push(device, {
+                .timeMs = now,
+                .ios = s.reads + s.writes,
+                .sectors = s.readSectors + s.writeSectors,
+                .ticksMs = s.readTicks + s.writeTicks,
+                .queueMs = s.ioInQueue,
+        });
+    }
+    samples_++;
+}
+
+void IoRateTracker::push(Device& device, const Sample& s) {
+    const size_t size = device.ring.size();
+    if (device.pushed > device.first) {
+        const Sample& last = device.ring[(device.pushed - 1) % size];
+        // A suspend or stalled loop leaves a hole the windows can't span, and
+        // a counter going backwards means a device reset or 32-bit wrap.
+        if (s.timeMs - last.timeMs > 2 * 1000 * static_cast<int64_t>(interval_seconds_) ||
+            s.ios < last.ios || s.sectors < last.sectors || s.ticksMs < last.ticksMs ||
+            s.queueMs < last.queueMs) {
+            device.first = device.pushed;
+            device.restarts++;
+        }
+    }
+
+    const uint64_t newest = device.pushed++;
+    device.ring[newest % size] = s;
+    if (device.pushed - device.first > size) {
+        device.first = device.pushed - size;
+    }
+
+    for (int w = 0; w < kNumWindows; ++w) {
+        uint64_t& base = device.base[w];
+        base = std::max(base, device.first);
+        int64_t windowStartMs = s.timeMs - 1000 * static_cast<int64_t>(kWindowSeconds[w]);
+        while (base + 1 < newest && device.ring[(base + 1) % size].timeMs <= windowStartMs) {
+            base++;
+        }
+
+        Rates& r = device.rates[w];
+        if (base == newest) {
+            r = {};
+            continue;
+        }
+        const Sample& old = device.ring[base % size];
+        double seconds = (s.timeMs - old.timeMs) / 1000.0;
+        if (seconds <= 0) {
+            continue;
+        }
+        uint64_t ios = s.ios - old.ios;
+        r.iops = ios / seconds;
+        r.bytesPerSecond = (s.sectors - old.sectors) * kSectorSize / seconds;
+        r.avgLatencyMs = ios ? static_cast<double>(s.ticksMs - old.ticksMs) / ios : 0;
+        r.avgQueueDepth = (s.queueMs - old.queueMs) / (seconds * 1000.0);
+        r.coveredSeconds = seconds;
+    }
+}
+
+void IoRateTracker::dump(int fd) {
+    std::lock_guard<std::mutex> _lock(lock_);
+    WriteStringToFd(StringPrintf("\nI/O rates (sampled every %ds, %" PRIu64 " samples):\n",
+                                 interval_seconds_, samples_),
+                    fd);
+    for (const auto& device : devices_) {
+        WriteStringToFd(StringPrintf("  %s: restarts=%" PRIu64 "\n", device.attr.name.c_str(),
+                                     device.restarts),
+                        fd);
+        for (int w = 0; w < kNumWindows; ++w) {
+            const Rates& r = device.rates[w];
+            WriteStringToFd(StringPrintf("  %s %2dm: iops=%.1f bytes/s=%.0f avg_latency_ms=%.2f "
+                                         "avg_queue_depth=%.2f (over %.0fs)\n",
+                                         device.attr.name.c_str(), kWindowSeconds[w] / 60, r.iops,
+                                         r.bytesPerSecond, r.avgLatencyMs, r.avgQueueDepth,
+                                         r.coveredSeconds),
+                            fd);
+        }
+    }
+}
+
+}  // namespace renesas
+}  // namespace V2_0
+}  // namespace health
+}  // namespace hardware
+}  // namespace android
@@ -0,0 +1,106 @@
+/*
+ * Copyright (C) 2018 GlobalLogic
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_HARDWARE_HEALTH_V2_0_RENESAS_IO_RATE_TRACKER_H
+#define ANDROID_HARDWARE_HEALTH_V2_0_RENESAS_IO_RATE_TRACKER_H
+
+#include <stdint.h>
+
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <android/hardware/health/2.0/types.h>
+
+#include <SysfsReader.h>
+
+namespace android {
+namespace hardware {
+namespace health {
+namespace V2_0 {
+namespace renesas {
+
+// Block device counters from /sys/block/<dev>/stat, sampled at a fixed
+// interval into a per-device ring. Every sample updates the 1- and 15-minute
+// rates from the newest sample and the newest one at least a window older,
+// found by timestamp; the kernel counters are cumulative, so this is
+// amortized O(1). The sampling timer stops in suspend, so a gap of more than
+// two intervals, or any counter going backwards, restarts the ring.
+class IoRateTracker {
+   public:
+    static constexpr int kNumWindows = 2;
+    static constexpr int kWindowSeconds[kNumWindows] = {60, 15 * 60};
+
+    struct Rates {
+        double iops;
+        double bytesPerSecond;
+        double avgLatencyMs;
+        double avgQueueDepth;
+        // Seconds actually covered; less than the window until the ring fills.
+        double coveredSeconds;
+    };
+
+    // Finds the MMC block devices and sizes the rings for |intervalSeconds|.
+    void init(int intervalSeconds);
+    int intervalSeconds() const { return interval_seconds_; }
+
+    // Reads the counters and pushes them into the rings.
+    void sample();
+    // Reads the counters without touching the rings.
+    void readStats(std::vector<DiskStats>& stats);
+
+    void dump(int fd);
+
+   private:
+    struct Sample {
+        int64_t timeMs;
+        uint64_t ios;
+        uint64_t sectors;
+        uint64_t ticksMs;
+        uint64_t queueMs;
+    };
+
+    struct Device {
+        StorageAttribute attr;
+        int stat;  // SysfsReader handle
+        std::vector<Sample> ring;
+        // Samples are numbered from 0 and stored at |number % ring.size()|.
+        uint64_t pushed = 0;
+        // Oldest sample still in the ring since the last restart.
+        uint64_t first = 0;
+        // Per window, the sample the rates are taken against.
+        uint64_t base[kNumWindows] = {};
+        uint64_t restarts = 0;
+        Rates rates[kNumWindows] = {};
+    };
+
+    bool parse(const Device& device, DiskStats* out) const;
+    void push(Device& device, const Sample& s);
+
+    std::mutex lock_;
+    SysfsReader reader_{SysfsReader::Backend::SYNC};
+    std::vector<Device> devices_;
+    int interval_seconds_ = 0;
+    uint64_t samples_ = 0;
+};
+
+}  // namespace renesas
+}  // namespace V2_0
+}  // namespace health
+}  // namespace hardware
+}  // namespace android
+
+#endif  // ANDROID_HARDWARE_HEALTH_V2_0_RENESAS_IO_RATE_TRACKER_H
@@ -0,0 +1,112 @@
+/*
+ * Copyright (C) 2018 GlobalLogic
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_HARDWARE_HEALTH_V2_0_RENESAS_LOCK_HOLD_STATS_H
+#define ANDROID_HARDWARE_HEALTH_V2_0_RENESAS_LOCK_HOLD_STATS_H
+
+#include <stdint.h>
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+
+namespace android {
+namespace hardware {
+namespace health {
+namespace V2_0 {
+namespace renesas {
+
+// Log2 histogram of how long a mutex was held; the stress harness also uses
+// it for call and delivery latencies. Bucket i counts durations in
+// [2^i, 2^(i+1)) ns, so percentiles are exact to within a factor of two.
+struct LockHoldStats {
+    static constexpr size_t kBuckets = 40;
+
+    std::atomic<uint64_t> buckets[kBuckets] = {};
+    std::atomic<uint64_t> count{0};
+    std::atomic<uint64_t> totalNs{0};
+    std::atomic<uint64_t> maxNs{0};
+
+    void record(uint64_t ns) {
+        size_t b = 0;
+        while (b + 1 < kBuckets && (ns >> (b + 1)) != 0) {
+            ++b;
+        }
+        buckets[b].fetch_add(1, std::memory_order_relaxed);
+        count.fetch_add(1, std::memory_order_relaxed);
+        totalNs.fetch_add(ns, std::memory_order_relaxed);
+        uint64_t prev = maxNs.load(std::memory_order_relaxed);
+        while (ns > prev && !maxNs.compare_exchange_weak(prev, ns, std::memory_order_relaxed)) {
+        }
+    }
+
+    void reset() {
+        for (auto& b : buckets) {
+            b.store(0, std::memory_order_relaxed);
+        }
+        count.store(0, std::memory_order_relaxed);
+        totalNs.store(0, std::memory_order_relaxed);
+        maxNs.store(0, std::memory_order_relaxed);
+    }
+
+    // Upper bound of the bucket containing the |p|-th percentile, p in [0, 1].
+    uint64_t percentileNs(double p) const {
+        uint64_t n = count.load(std::memory_order_relaxed);
+        if (n == 0) {
+            return 0;
+        }
+        uint64_t rank = static_cast<uint64_t>(p * (n - 1)) + 1;
+        uint64_t seen = 0;
+        for (size_t b = 0; b < kBuckets; ++b) {
+            seen += buckets[b].load(std::memory_order_relaxed);
+            if (seen >= rank) {
+                return (uint64_t{2} << b) - 1;
+            }
+        }
+        return maxNs.load(std::memory_order_relaxed);
+    }
+};
+
+// std::lock_guard that records the hold time into a LockHoldStats.
+class TimedLockGuard {
+   public:
+    TimedLockGuard(std::mutex& mutex, LockHoldStats& stats) : mutex_(mutex), stats_(stats) {
+        mutex_.lock();
+        start_ = std::chrono::steady_clock::now();
+    }
+
+    ~TimedLockGuard() {
+        auto held = std::chrono::steady_clock::now() - start_;
+        mutex_.unlock();
+        stats_.record(std::chrono::duration_cast<std::chrono::nanoseconds>(held).count());
+    }
+
+    TimedLockGuard(const TimedLockGuard&) = delete;
+    TimedLockGuard& operator=(const TimedLockGuard&) = delete;
+
+   private:
+    std::mutex& mutex_;
+    LockHoldStats& stats_;
+    std::chrono::steady_clock::time_point start_;
+};
+
+}  // namespace renesas
+}  // namespace V2_0
+}  // namespace health
+}  // namespace hardware
+}  // namespace android
+
+#endif  // ANDROID_HARDWARE_HEALTH_V2_0_RENESAS_LOCK_HOLD_STATS_H
@@ -0,0 +1,214 @@
+/*
+ * Copyright (C) 2018 GlobalLogic
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "android.hardware.health@2.0-impl"
+
+#include <StallDetector.h>
+
+#include <dlfcn.h>
+#include <inttypes.h>
+#include <unistd.h>
+
+#include <memory>
+
+#include <android-base/file.h>
+#include <android-base/logging.h>
+#include <android-base/stringprintf.h>
+#include <backtrace/Backtrace.h>
+#include <utils/SystemClock.h>
+
+using android::base::StringPrintf;
+using android::base::WriteStringToFd;
+
+namespace android {
+namespace hardware {
+namespace health {
+namespace V2_0 {
+namespace renesas {
+
+StallDetector::~StallDetector() {
+    {
+        std::lock_guard<std::mutex> _lock(lock_);
+        stopping_ = true;
+    }
+    cv_.notify_all();
+    if (watchdog_.joinable()) {
+        watchdog_.join();
+    }
+}
+
+void StallDetector::start(int64_t budgetMs) {
+    std::lock_guard<std::mutex> _lock(lock_);
+    if (enabled_ || budgetMs <= 0) {
+        return;
+    }
+    enabled_ = true;
+    tid_ = gettid();
+    budget_ = std::chrono::milliseconds(budgetMs);
+    watchdog_ = std::thread([this] { watchdogLoop(); });
+}
+
+void StallDetector::begin(const char* name) {
+    std::lock_guard<std::mutex> _lock(lock_);
+    beginLocked(name);
+}
+
+void StallDetector::begin(void* handler) {
+    std::lock_guard<std::mutex> _lock(lock_);
+    if (!enabled_) {
+        return;
+    }
+    beginLocked(handlerNameLocked(handler));
+}
+
+void StallDetector::beginLocked(const char* name) {
+    if (!enabled_) {
+        return;
+    }
+    active_ = true;
+    ++seq_;
+    name_ = name;
+    start_ = Clock::now();
+    // Only an idle watchdog needs waking; a busy one re-checks on its own.
+    if (idle_) {
+        cv_.notify_one();
+    }
+}
+
+void StallDetector::end() {
+    std::lock_guard<std::mutex> _lock(lock_);
+    if (!enabled_ || !active_) {
+        return;
+    }
+    active_ = false;
+
+    auto duration = Clock::now() - start_;
+    if (duration <= budget_) {
+        return;
+    }
+
+    int64_t durationMs = std::chrono::duration_cast<std::chrono::milliseconds>(duration).count();
+    Stall& stall = stalls_[total_stalls_ % kMaxStalls];
+    stall.name = name_;
+    stall.durationMs = durationMs;
+    stall.bootTimeMs = elapsedRealtime() - durationMs;
+    stall.stack = reported_seq_ == seq_ ? std::move(reported_stack_) : std::string();
+    reported_stack_.clear();
+    total_stalls_++;
+    if (num_stalls_ < kMaxStalls) {
+        num_stalls_++;
+    }
+    LOG(WARNING) << "health main loop: " << name_ << " took " << durationMs << "ms (budget "
+                 << budget_.count() << "ms)";
+}
+
+void StallDetector::watchdogLoop() {
+    std::unique_lock<std::mutex> lock(lock_);
+    while (!stopping_) {
+        if (!active_) {
+            idle_ = true;
+            cv_.wait(lock);
+            idle_ = false;
+            continue;
+        }
+
+        uint64_t seq = seq_;
+        auto deadline = start_ + budget_;
+        if (Clock::now() < deadline) {
+            cv_.wait_until(lock, deadline);
+            continue;
+        }
+
+        if (reported_seq_ != seq) {
+            reported_seq_ = seq;
+            const char* name = name_;
+            int64_t elapsedMs =
+                    std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() - start_)
+                            .count();
+            // The loop thread may finish meanwhile; the stack is then
+            // whatever it moved on to, which the log makes clear.
+            lock.unlock();
+            std::string stack = captureStack();
+            LOG(WARNING) << "health main loop: " << name << " still running after " << elapsedMs
+                         << "ms\n"
+                         << stack;
+            lock.lock();
+            if (seq_ == seq && active_) {
+                reported_stack_ = std::move(stack);
+            }
+        }
+        cv_.wait_for(lock, budget_);
+    }
+}
+
+std::string StallDetector::captureStack() {
+    std::unique_ptr<Backtrace> backtrace(Backtrace::Create(getpid(), tid_));
+    if (backtrace == nullptr || !backtrace->Unwind(0)) {
+        return "  <unwind failed>\n";
+    }
+    std::string stack;
+    for (size_t i = 0; i < backtrace->NumFrames(); ++i) {
+        stack += "  " + backtrace->FormatFrameData(i) + "\n";
+    }
+    return stack;
+}
+
+void StallDetector::setHandlerName(void* handler, const char* name) {
+    std::lock_guard<std::mutex> _lock(lock_);
+    handler_names_[handler] = name;
+}
+
+const char* StallDetector::handlerNameLocked(void* handler) {
+    auto it = handler_names_.find(handler);
+    if (it != handler_names_.end()) {
+        return it->second.c_str();
+    }
+
+    Dl_info info;
+    std::string name;
+    if (dladdr(handler, &info) != 0 && info.dli_sname != nullptr &&
+        info.dli_saddr == handler) {
+        name = info.dli_sname;
+    } else {
+        name = StringPrintf("handler %p", handler);
+    }
+    return handler_names_.emplace(handler, std::move(name)).first->second.c_str();
+}
+
+void StallDetector::dump(int fd) {
+    std::lock_guard<std::mutex> _lock(lock_);
+    if (!enabled_) {
+        WriteStringToFd("\nmain loop stalls: detection disabled\n", fd);
+        return;
+    }
+    WriteStringToFd(StringPrintf("\nmain loop stalls (budget %" PRId64 "ms): %" PRIu64 " total\n",
+                                 static_cast<int64_t>(budget_.count()), total_stalls_),
+                    fd);
+    // Newest first.
+    for (size_t i = 0; i < num_stalls_; ++i) {
+        const Stall& stall = stalls_[(total_stalls_ - 1 - i) % kMaxStalls];
+        WriteStringToFd(StringPrintf("  at %" PRId64 "ms: %s took %" PRId64 "ms\n",
+                                     stall.bootTimeMs, stall.name.c_str(), stall.durationMs),
+                        fd);
+        WriteStringToFd(stall.stack, fd);
+    }
+}
+
+}  // namespace renesas
+}  // namespace V2_0
+}  // namespace health
+}  // namespace hardware
+}  // namespace android
@@ -0,0 +1,128 @@
+/*
+ * Copyright (C) 2018 GlobalLogic
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_HARDWARE_HEALTH_V2_0_RENESAS_STALL_DETECTOR_H
+#define ANDROID_HARDWARE_HEALTH_V2_0_RENESAS_STALL_DETECTOR_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <array>
+#include <chrono>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+
+namespace android {
+namespace hardware {
+namespace health {
+namespace V2_0 {
+namespace renesas {
+
+// Watchdog for a single-threaded event loop. The loop brackets every handler
+// with begin()/end(); a watchdog thread that sees one run past the budget logs
+// it with a stack of the loop thread, and end() records it in a small ring
+// that dump() prints.
+class StallDetector {
+   public:
+    static constexpr size_t kMaxStalls = 16;
+
+    StallDetector() = default;
+    ~StallDetector();
+
+    // Starts watching the calling thread. |budgetMs| <= 0 disables detection.
+    void start(int64_t budgetMs);
+
+    // |name| must outlive the dispatch.
+    void begin(const char* name);
+    // Dispatch of an epoll handler, reported under the name set below, else
+    // its exported symbol, else its address.
+    void begin(void* handler);
+    void end();
+
+    // Names |handler| for reports. Static handlers have no dynamic symbol, so
+    // every in-tree handler is named when it is registered.
+    void setHandlerName(void* handler, const char* name);
+
+    void dump(int fd);
+
+   private:
+    using Clock = std::chrono::steady_clock;
+
+    struct Stall {
+        std::string name;
+        int64_t bootTimeMs;
+        int64_t durationMs;
+        std::string stack;
+    };
+
+    void beginLocked(const char* name);
+    // Stable printable name for |handler|, looked up once and cached.
+    const char* handlerNameLocked(void* handler);
+    void watchdogLoop();
+    std::string captureStack();
+
+    std::mutex lock_;
+    std::condition_variable cv_;
+    std::thread watchdog_;
+    bool enabled_ = false;
+    bool stopping_ = false;
+    bool idle_ = false;
+    pid_t tid_ = 0;
+    std::chrono::milliseconds budget_{0};
+
+    // Current dispatch.
+    bool active_ = false;
+    uint64_t seq_ = 0;
+    const char* name_ = nullptr;
+    Clock::time_point start_;
+    uint64_t reported_seq_ = 0;
+    std::string reported_stack_;
+
+    std::array<Stall, kMaxStalls> stalls_;
+    size_t num_stalls_ = 0;
+    uint64_t total_stalls_ = 0;
+
+    std::map<void*, std::string> handler_names_;
+};
+
+// Brackets one dispatch of |detector|.
+class StallScope {
+   public:
+    StallScope(StallDetector& detector, const char* name) : detector_(detector) {
+        detector_.begin(name);
+    }
+    StallScope(StallDetector& detector, void* handler) : detector_(detector) {
+        detector_.begin(handler);
+    }
+    ~StallScope() { detector_.end(); }
+
+    StallScope(const StallScope&) = delete;
+    StallScope& operator=(const StallScope&) = delete;
+
+   private:
+    StallDetector& detector_;
+};
+
+}  // namespace renesas
+}  // namespace V2_0
+}  // namespace health
+}  // namespace hardware
+}  // namespace android
+
+#endif  // ANDROID_HARDWARE_HEALTH_V2_0_RENESAS_STALL_DETECTOR_H
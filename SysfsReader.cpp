@@ -0,0 +1,308 @@
+/*
+ * Copyright (C) 2018 GlobalLogic
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "HealthHAL"
+
+#include <SysfsReader.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <string.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+
+#include <android-base/file.h>
+#include <android-base/logging.h>
+#include <android-base/properties.h>
+#include <android-base/stringprintf.h>
+#ifdef HEALTHD_USE_IO_URING
+#include <liburing.h>
+#endif
+
+namespace android {
+namespace hardware {
+namespace health {
+namespace V2_0 {
+namespace renesas {
+
+#ifdef HEALTHD_USE_IO_URING
+// Larger attribute sets are submitted in several batches.
+static constexpr unsigned kMaxRingEntries = 64;
+#endif
+
+SysfsReader::SysfsReader(Backend backend) : backend_(Backend::SYNC) {
+    setBackend(backend);
+}
+
+SysfsReader::~SysfsReader() {
+    clear();
+    releaseIoUring();
+}
+
+int SysfsReader::add(const std::string& path) {
+    int fd = TEMP_FAILURE_RETRY(open(path.c_str(), O_RDONLY | O_CLOEXEC));
+    if (fd < 0) {
+        LOG(WARNING) << LOG_TAG << " File " << path << " doesn't exist";
+        return -1;
+    }
+    attrs_.push_back({fd, std::string()});
+    buf_.resize(attrs_.size() * kMaxAttrSize);
+    return static_cast<int>(attrs_.size() - 1);
+}
+
+void SysfsReader::clear() {
+    for (auto& attr : attrs_) {
+        close(attr.fd);
+    }
+    attrs_.clear();
+    buf_.clear();
+}
+
+const std::string& SysfsReader::value(int handle) const {
+    static const std::string empty;
+    if (handle < 0 || static_cast<size_t>(handle) >= attrs_.size()) {
+        return empty;
+    }
+    return attrs_[handle].value;
+}
+
+void SysfsReader::setValue(size_t i, ssize_t len) {
+    if (len <= 0) {
+        attrs_[i].value.clear();
+        return;
+    }
+    const char* data = &buf_[i * kMaxAttrSize];
+    const char* end = data + len;
+    const char* eol = std::find(data, end, '\n');
+    attrs_[i].value.assign(data, eol);
+}
+
+void SysfsReader::refresh() {
+    auto start = std::chrono::steady_clock::now();
+    uint64_t syscalls = 0;
+
+    if (backend_ == Backend::IO_URING) {
+        if (readIoUring(&syscalls)) {
+            record(Backend::IO_URING, syscalls, elapsedNs(start));
+            return;
+        }
+        // The failed batch is charged to IO_URING; the sync retry below is a
+        // refresh of its own.
+        LOG(WARNING) << LOG_TAG << " io_uring batch failed, falling back to synchronous reads";
+        stats_[static_cast<size_t>(Backend::IO_URING)].failures++;
+        record(Backend::IO_URING, syscalls, elapsedNs(start));
+        releaseIoUring();
+        backend_ = Backend::SYNC;
+        start = std::chrono::steady_clock::now();
+    }
+    syscalls = readSync();
+    record(Backend::SYNC, syscalls, elapsedNs(start));
+}
+
+uint64_t SysfsReader::elapsedNs(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() -
+                                                                start)
+            .count();
+}
+
+void SysfsReader::record(Backend backend, uint64_t syscalls, uint64_t wallNs) {
+    Stats& stats = stats_[static_cast<size_t>(backend)];
+    stats.refreshes++;
+    stats.syscalls += syscalls;
+    stats.wallNs += wallNs;
+    stats.lastSyscalls = syscalls;
+    stats.lastWallNs = wallNs;
+}
+
+void SysfsReader::refresh(int handle) {
+    if (handle < 0 || static_cast<size_t>(handle) >= attrs_.size()) {
+        return;
+    }
+    ssize_t len = TEMP_FAILURE_RETRY(
+            pread(attrs_[handle].fd, &buf_[handle * kMaxAttrSize], kMaxAttrSize - 1, 0));
+    setValue(handle, len);
+}
+
+uint64_t SysfsReader::readSync() {
+    for (size_t i = 0; i < attrs_.size(); ++i) {
+        ssize_t len = TEMP_FAILURE_RETRY(
+                pread(attrs_[i].fd, &buf_[i * kMaxAttrSize], kMaxAttrSize - 1, 0));
+        setValue(i, len);
+    }
+    return attrs_.size();
+}
+
+#ifdef HEALTHD_USE_IO_URING
+bool SysfsReader::readIoUring(uint64_t* syscalls) {
+    if (!initIoUring()) {
+        return false;
+    }
+
+    std::vector<struct iovec> iov(attrs_.size());
+    size_t next = 0;
+    while (next < attrs_.size()) {
+        unsigned batch = 0;
+        while (next + batch < attrs_.size() && batch < ring_entries_) {
+            size_t i = next + batch;
+            struct io_uring_sqe* sqe = io_uring_get_sqe(ring_);
+            if (sqe == nullptr) {
+                break;
+            }
+            iov[i].iov_base = &buf_[i * kMaxAttrSize];
+            iov[i].iov_len = kMaxAttrSize - 1;
+            io_uring_prep_readv(sqe, attrs_[i].fd, &iov[i], 1, 0);
+            io_uring_sqe_set_data(sqe, reinterpret_cast<void*>(i));
+            ++batch;
+        }
+
+        int ret = io_uring_submit_and_wait(ring_, batch);
+        ++*syscalls;
+        if (ret < 0) {
+            LOG(WARNING) << LOG_TAG << " io_uring_submit_and_wait: " << strerror(-ret);
+            return false;
+        }
+
+        for (unsigned done = 0; done < batch; ++done) {
+            struct io_uring_cqe* cqe = nullptr;
+            ret = io_uring_peek_cqe(ring_, &cqe);
+            if (ret == -EAGAIN) {
+                ret = io_uring_wait_cqe(ring_, &cqe);
+                ++*syscalls;
+            }
+            if (ret < 0) {
+                LOG(WARNING) << LOG_TAG << " io_uring_wait_cqe: " << strerror(-ret);
+                return false;
+            }
+            size_t i = reinterpret_cast<size_t>(io_uring_cqe_get_data(cqe));
+            setValue(i, cqe->res);
+            io_uring_cqe_seen(ring_, cqe);
+        }
+        next += batch;
+    }
+    return true;
+}
+
+bool SysfsReader::initIoUring() {
+    unsigned entries = 1;
+    while (entries < attrs_.size() && entries < kMaxRingEntries) {
+        entries <<= 1;
+    }
+    if (ring_ != nullptr && ring_entries_ >= entries) {
+        return true;
+    }
+
+    releaseIoUring();
+    ring_ = new io_uring();
+    int ret = io_uring_queue_init(entries, ring_, 0);
+    if (ret < 0) {
+        LOG(WARNING) << LOG_TAG << " io_uring_queue_init: " << strerror(-ret);
+        delete ring_;
+        ring_ = nullptr;
+        return false;
+    }
+    ring_entries_ = entries;
+    return true;
+}
+
+void SysfsReader::releaseIoUring() {
+    if (ring_ == nullptr) {
+        return;
+    }
+    io_uring_queue_exit(ring_);
+    delete ring_;
+    ring_ = nullptr;
+    ring_entries_ = 0;
+}
+#else
+bool SysfsReader::readIoUring(uint64_t*) {
+    return false;
+}
+
+bool SysfsReader::initIoUring() {
+    LOG(WARNING) << LOG_TAG << " io_uring backend not built in (HEALTHD_USE_IO_URING)";
+    return false;
+}
+
+void SysfsReader::releaseIoUring() {}
+#endif  // HEALTHD_USE_IO_URING
+
+bool SysfsReader::setBackend(Backend backend) {
+    if (backend == Backend::IO_URING && !initIoUring()) {
+        backend_ = Backend::SYNC;
+        return false;
+    }
+    if (backend == Backend::SYNC) {
+        releaseIoUring();
+    }
+    backend_ = backend;
+    return true;
+}
+
+void SysfsReader::dumpStats(int fd) const {
+    for (size_t b = 0; b < kNumBackends; ++b) {
+        const Stats& s = stats_[b];
+        if (s.refreshes == 0) {
+            continue;
+        }
+        android::base::WriteStringToFd(
+                android::base::StringPrintf(
+                        "  %s%s: refreshes=%" PRIu64 " avg_syscalls=%.1f avg_wall_us=%.1f"
+                        " last_syscalls=%" PRIu64 " last_wall_us=%.1f failures=%" PRIu64 "\n",
+                        backendName(static_cast<Backend>(b)),
+                        static_cast<Backend>(b) == backend_ ? " (active)" : "", s.refreshes,
+                        static_cast<double>(s.syscalls) / s.refreshes,
+                        s.wallNs / 1000.0 / s.refreshes, s.lastSyscalls, s.lastWallNs / 1000.0,
+                        s.failures),
+                fd);
+    }
+}
+
+SysfsReader::Backend SysfsReader::defaultBackend() {
+    Backend backend = Backend::SYNC;
+    parseBackend(android::base::GetProperty("ro.vendor.health.sysfs_backend", "sync"), &backend);
+    return backend;
+}
+
+const char* SysfsReader::backendName(Backend backend) {
+    switch (backend) {
+        case Backend::SYNC:
+            return "sync";
+        case Backend::IO_URING:
+            return "io_uring";
+    }
+    return "unknown";
+}
+
+bool SysfsReader::parseBackend(const std::string& name, Backend* backend) {
+    if (name == "sync") {
+        *backend = Backend::SYNC;
+    } else if (name == "io_uring") {
+        *backend = Backend::IO_URING;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+}  // namespace renesas
+}  // namespace V2_0
+}  // namespace health
+}  // namespace hardware
+}  // namespace android
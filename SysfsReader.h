@@ -0,0 +1,116 @@
+/*
+ * Copyright (C) 2018 GlobalLogic
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_HARDWARE_HEALTH_V2_0_RENESAS_SYSFS_READER_H
+#define ANDROID_HARDWARE_HEALTH_V2_0_RENESAS_SYSFS_READER_H
+
+#include <stdint.h>
+
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+
+struct io_uring;
+
+namespace android {
+namespace hardware {
+namespace health {
+namespace V2_0 {
+namespace renesas {
+
+// Reads a fixed set of small sysfs attributes. Every attribute is opened once
+// and re-read from offset 0 on each refresh(), either with one pread() per
+// attribute (SYNC) or with all reads submitted as a single io_uring batch
+// (IO_URING). If io_uring is not available the reader falls back to SYNC.
+// IO_URING is only built in with -DHEALTHD_USE_IO_URING (see Android.bp).
+//
+// Not thread-safe; callers serialize access.
+class SysfsReader {
+   public:
+    enum class Backend { SYNC = 0, IO_URING = 1 };
+    static constexpr size_t kNumBackends = 2;
+
+    struct Stats {
+        uint64_t refreshes = 0;
+        uint64_t syscalls = 0;
+        uint64_t wallNs = 0;
+        uint64_t lastSyscalls = 0;
+        uint64_t lastWallNs = 0;
+        // io_uring batches that failed and were retried with SYNC.
+        uint64_t failures = 0;
+    };
+
+    explicit SysfsReader(Backend backend = defaultBackend());
+    ~SysfsReader();
+
+    // Opens |path| and returns a handle for value(), or -1 if it can't be opened.
+    int add(const std::string& path);
+    // Closes all attributes. Statistics are kept.
+    void clear();
+    size_t size() const { return attrs_.size(); }
+
+    // Re-reads every attribute with the current backend.
+    void refresh();
+    // Re-reads only |handle|, with a single pread().
+    void refresh(int handle);
+    // First line of the attribute as of the last refresh(); empty if the
+    // handle is invalid or the read failed.
+    const std::string& value(int handle) const;
+
+    Backend backend() const { return backend_; }
+    // Returns false (and keeps SYNC) if |backend| is not supported here.
+    bool setBackend(Backend backend);
+    const Stats& stats(Backend backend) const { return stats_[static_cast<size_t>(backend)]; }
+    void dumpStats(int fd) const;
+
+    // Backend selected by ro.vendor.health.sysfs_backend ("sync" or "io_uring").
+    static Backend defaultBackend();
+    static const char* backendName(Backend backend);
+    static bool parseBackend(const std::string& name, Backend* backend);
+
+   private:
+    // Sysfs attributes read here are all well below a page.
+    static constexpr size_t kMaxAttrSize = 256;
+
+    struct Attr {
+        int fd;
+        std::string value;
+    };
+
+    uint64_t readSync();
+    bool readIoUring(uint64_t* syscalls);
+    bool initIoUring();
+    void releaseIoUring();
+    void setValue(size_t i, ssize_t len);
+    void record(Backend backend, uint64_t syscalls, uint64_t wallNs);
+    static uint64_t elapsedNs(std::chrono::steady_clock::time_point start);
+
+    std::vector<Attr> attrs_;
+    std::vector<char> buf_;
+    Backend backend_;
+    struct io_uring* ring_ = nullptr;
+    unsigned ring_entries_ = 0;
+    Stats stats_[kNumBackends];
+};
+
+}  // namespace renesas
+}  // namespace V2_0
+}  // namespace health
+}  // namespace hardware
+}  // namespace android
+
+#endif  // ANDROID_HARDWARE_HEALTH_V2_0_RENESAS_SYSFS_READER_H
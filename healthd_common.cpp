@@ -33,7 +33,10 @@
 #include <unistd.h>
 #include <utils/Errors.h>
 
+#include <android-base/properties.h>
+
 #include <HealthImpl.h>
+#include <StallDetector.h>
 
 using namespace android;
 
@@ -41,22 +44,15 @@ using namespace android;
 #define DEFAULT_PERIODIC_CHORES_INTERVAL_FAST (60 * 1)
 // Periodic chores fast interval in seconds
 #define DEFAULT_PERIODIC_CHORES_INTERVAL_SLOW (60 * 10)
+// Main loop handlers running longer than this are reported, in milliseconds
+#define DEFAULT_STALL_BUDGET_MS 1000
 
+// The battery*Path fields are left empty for BatteryMonitor::init() to
+// discover; the battery properties dump shows what it found.
 static struct healthd_config healthd_config = {
     .periodic_chores_interval_fast = DEFAULT_PERIODIC_CHORES_INTERVAL_FAST,
     .periodic_chores_interval_slow = DEFAULT_PERIODIC_CHORES_INTERVAL_SLOW,
-    .batteryStatusPath = String8(String8::kEmptyString),
-    .batteryHealthPath = String8(String8::kEmptyString),
-    .batteryPresentPath = String8(String8::kEmptyString),
-    .batteryCapacityPath = String8(String8::kEmptyString),
-    .batteryVoltagePath = String8(String8::kEmptyString),
-    .batteryTemperaturePath = String8(String8::kEmptyString),
-    .batteryTechnologyPath = String8(String8::kEmptyString),
-    .batteryCurrentNowPath = String8(String8::kEmptyString),
-    .batteryCurrentAvgPath = String8(String8::kEmptyString),
-    .batteryChargeCounterPath = String8(String8::kEmptyString),
-    .batteryFullChargePath = String8(String8::kEmptyString),
-    .batteryCycleCountPath = String8(String8::kEmptyString),
+    // Set by sw_energy_init() if ro.vendor.health.sw_energy_interval_ms is set.
     .energyCounter = NULL,
     .boot_min_cap = 0,
     .screen_on = NULL,
@@ -66,6 +62,8 @@ static int eventct;
 static int epollfd;
 
 #define POWER_SUPPLY_SUBSYSTEM "power_supply"
+#define MMC_SUBSYSTEM "mmc"
+#define BLOCK_SUBSYSTEM "block"
 
 // epoll_create() parameter is actually unused
 #define MAX_EPOLL_EVENTS 40
@@ -78,6 +76,10 @@ static int awake_poll_interval = -1;
 static int wakealarm_wake_interval = DEFAULT_PERIODIC_CHORES_INTERVAL_FAST;
 
 using ::android::hardware::health::V2_0::renesas::Health;
+using ::android::hardware::health::V2_0::renesas::StallDetector;
+using ::android::hardware::health::V2_0::renesas::StallScope;
+
+static StallDetector stall_detector;
 
 struct healthd_mode_ops* healthd_mode_ops = nullptr;
 
@@ -100,6 +102,19 @@ int healthd_register_event(int fd, void (*handler)(uint32_t), EventWakeup wakeup
     return 0;
 }
 
+int healthd_register_named_event(int fd, void (*handler)(uint32_t), EventWakeup wakeup,
+                                 const char* name) {
+    if (healthd_register_event(fd, handler, wakeup)) {
+        return -1;
+    }
+    stall_detector.setHandlerName((void*)handler, name);
+    return 0;
+}
+
+void healthd_dump_stalls(int fd) {
+    stall_detector.dump(fd);
+}
+
 static void wakealarm_set_interval(int interval) {
     struct itimerspec itval;
 
@@ -149,7 +164,8 @@ void healthd_battery_update_internal(bool charger_online) {
 }
 
 static void healthd_battery_update(void) {
-    Health::getImplementation()->update();
+    // Uevents and wakealarms always need a fresh update.
+    Health::getImplementation()->requestUpdate(std::chrono::milliseconds(0));
 }
 
 static void periodic_chores() {
@@ -180,9 +196,14 @@ static void uevent_event(uint32_t /*epevents*/) {
             healthd_battery_update();
             break;
         }
+        if (!strcmp(cp, "SUBSYSTEM=" MMC_SUBSYSTEM) || !strcmp(cp, "SUBSYSTEM=" BLOCK_SUBSYSTEM)) {
+            invalidate_storage_devices();
+            break;
+        }
 
         /* advance to after the next \0 */
-        for (; *cp; cp++);
+        while (*cp++)
+            ;
     }
 }
 
@@ -195,7 +216,7 @@ static void uevent_init(void) {
     }
 
     fcntl(uevent_fd, F_SETFL, O_NONBLOCK);
-    if (healthd_register_event(uevent_fd, uevent_event, EVENT_WAKEUP_FD)) {
+    if (healthd_register_named_event(uevent_fd, uevent_event, EVENT_WAKEUP_FD, "uevent")) {
         KLOG_ERROR(LOG_TAG, "register for uevent events failed\n");
     }
 }
@@ -218,7 +239,8 @@ static void wakealarm_init(void) {
         return;
     }
 
-    if (healthd_register_event(wakealarm_fd, wakealarm_event, EVENT_WAKEUP_FD)) {
+    if (healthd_register_named_event(wakealarm_fd, wakealarm_event, EVENT_WAKEUP_FD,
+                                     "wakealarm")) {
         KLOG_ERROR(LOG_TAG, "Registration of wakealarm event failed\n");
     }
 
@@ -234,12 +256,19 @@ static void healthd_mainloop(void) {
 
         /* Don't wait for first timer timeout to run periodic chores */
         if (!nevents) {
+            StallScope scope(stall_detector, "periodic_chores");
             periodic_chores();
         }
 
-        healthd_mode_ops->heartbeat();
+        {
+            StallScope scope(stall_detector, "heartbeat");
+            healthd_mode_ops->heartbeat();
+        }
 
-        mode_timeout = healthd_mode_ops->preparetowait();
+        {
+            StallScope scope(stall_detector, "preparetowait");
+            mode_timeout = healthd_mode_ops->preparetowait();
+        }
         if (timeout < 0 || (mode_timeout > 0 && mode_timeout < timeout)) {
             timeout = mode_timeout;
         }
@@ -254,6 +283,7 @@ static void healthd_mainloop(void) {
 
         for (int n = 0; n < nevents; ++n) {
             if (events[n].data.ptr) {
+                StallScope scope(stall_detector, events[n].data.ptr);
                 (*(void (*)(int))events[n].data.ptr)(events[n].events);
             }
         }
@@ -267,6 +297,9 @@ static int healthd_init() {
         return -1;
     }
 
+    stall_detector.start(android::base::GetIntProperty("ro.vendor.health.stall_budget_ms",
+                                                       DEFAULT_STALL_BUDGET_MS));
+
     healthd_mode_ops->init(&healthd_config);
     wakealarm_init();
     uevent_init();